@@ -24,6 +24,10 @@
 #
 # LIBTCL           Linker options needed to link against the TCL library.
 #
+# THREADSAFE       1 to build a library whose connections may be used by
+#                  different threads, one thread per connection at a time.
+#                  0, the default, for a single-threaded library.
+#
 # Once the macros above are defined, the rest of this make script will
 # build the product
 ################################################################################
@@ -32,21 +36,28 @@
 #
 TCCX =  $(TCC) $(OPTS) -I. -I$(TOP)/src -I$(TOP)
 TCCX += -DSQLITE_OMIT_LOAD_EXTENSION
-TCCX += -DSQLITE_THREADSAFE=0
+THREADSAFE ?= 0
+TCCX += -DSQLITE_THREADSAFE=$(THREADSAFE)
+TCCX += -DSQLITE_DEFAULT_MEMSTATUS=0
 
 # Object files for the XJD1 library.
 #
+LIBOBJ+= async.o
 LIBOBJ+= complete.o conn.o context.o
 LIBOBJ+= datasrc.o delete.o
 LIBOBJ+= expr.o
 LIBOBJ+= func.o
+LIBOBJ+= insert.o
 LIBOBJ+= json.o
 LIBOBJ+= memory.o
+LIBOBJ+= number.o
 LIBOBJ+= parse.o pragma.o
 LIBOBJ+= query.o
 LIBOBJ+= sqlite3.o stmt.o string.o
-LIBOBJ+= tokenize.o trace.o
+LIBOBJ+= tokenize.o trace.o trans.o
 LIBOBJ+= update.o
+LIBOBJ+= value.o
+LIBOBJ+= writebuf.o
 
 # All of the source code files.
 #
@@ -125,7 +136,7 @@ parse.c:	$(TOP)/src/parse.y lemon
 	./lemon $(OPTS) parse.y
 
 sqlite3.o:	$(TOP)/src/sqlite3.c $(TOP)/src/sqlite3.h
-	$(TCCX) -c -DSQLITE_NO_SYNC -DSQLITE_THREADSAFE=0 -DSQLITE_OMIT_LOADEXTENSION $<
+	$(TCCX) -c -DSQLITE_NO_SYNC -DSQLITE_OMIT_LOADEXTENSION $<
 
 clean:	
 	rm -f *.o lib*.a
@@ -0,0 +1,588 @@
+/*
+** Copyright (c) 2011 D. Richard Hipp
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the Simplified BSD License (also
+** known as the "2-Clause License" or "FreeBSD License".)
+**
+** This program is distributed in the hope that it will be useful,
+** but without any warranty; without even the implied warranty of
+** merchantability or fitness for a particular purpose.
+**
+** Author contact information:
+**   drh@hwaci.com
+**   http://www.hwaci.com/drh/
+**
+*************************************************************************
+** Code to implement ASYNC INSERT.
+**
+** The documents of an ASYNC INSERT are rendered and handed to a writer,
+** and the statement returns at once.  There are two writers.
+**
+** In a thread-safe build, a connection to a database in WAL mode starts
+** a writer thread the first time an ASYNC INSERT is run outside of a
+** transaction.  The thread has its own connection to the database file.
+** Documents are passed to it through a ring of XJD1_ASYNC_RING slots,
+** and it writes them as one transaction when the ring holds
+** AsyncQueue.mxDoc documents, when the oldest has waited
+** AsyncQueue.msWindow milliseconds, or when the connection asks it to.
+** If the ring is full, the ASYNC INSERT waits for space.
+**
+** WAL mode is required because the main connection may be reading, for
+** example between steps of a SELECT, while the thread writes.  With a
+** rollback journal the reader would stop the writer from committing, and
+** the ASYNC INSERT would then wait for the writer forever.
+**
+** Otherwise, and for an ASYNC INSERT inside a transaction, the documents
+** are appended to a queue owned by the connection.  The queue is written
+** as one transaction, or one savepoint if a transaction is open, when it
+** holds AsyncQueue.mxDoc documents, or when a statement is prepared or
+** run more than AsyncQueue.msWindow milliseconds after the oldest
+** document was queued.
+**
+** With either writer, any statement other than an ASYNC INSERT first
+** waits until every document queued before it is written, so that it
+** sees them.  So do xjd1_flush() and xjd1_close().
+**
+** If a batch of documents cannot be written, none of them are stored.
+** The error is returned by the next call on the connection that prepares
+** or runs a statement, or that flushes the queue.
+*/
+#include "xjd1Int.h"
+
+/*
+** The writer thread is only built into a thread-safe library.
+*/
+#if defined(SQLITE_THREADSAFE) && SQLITE_THREADSAFE>0 && !defined(_WIN32)
+# define ASYNC_THREAD 1
+# include <pthread.h>
+# include <time.h>
+#else
+# define ASYNC_THREAD 0
+#endif
+
+/*
+** Number of documents the ring of a writer thread can hold.
+*/
+#ifndef XJD1_ASYNC_RING
+# define XJD1_ASYNC_RING 4096
+#endif
+
+/*
+** Set up the queue of a new connection.
+*/
+void xjd1AsyncInit(xjd1 *pConn){
+  AsyncQueue *pQ = &pConn->sAsync;
+  memset(pQ, 0, sizeof(*pQ));
+  xjd1StringInit(&pQ->sText, 0, 0);
+  pQ->iLastName = -1;
+  pQ->mxDoc = XJD1_DEFAULT_ASYNC_BATCH;
+  pQ->msWindow = XJD1_DEFAULT_ASYNC_WINDOW;
+}
+
+/*
+** Return the current time in milliseconds, as seen by the default VFS.
+*/
+static i64 asyncNow(void){
+  sqlite3_vfs *pVfs = sqlite3_vfs_find(0);
+  sqlite3_int64 iNow;
+  double rNow;
+  if( pVfs==0 ) return 0;
+  if( pVfs->iVersion>=2 && pVfs->xCurrentTimeInt64 ){
+    pVfs->xCurrentTimeInt64(pVfs, &iNow);
+    return iNow;
+  }
+  pVfs->xCurrentTime(pVfs, &rNow);
+  return (i64)(rNow*86400000.0);
+}
+
+/*
+** Forget every document in the queue.
+*/
+static void asyncReset(AsyncQueue *pQ){
+  pQ->nDoc = 0;
+  pQ->iLastName = -1;
+  xjd1StringTruncate(&pQ->sText);
+}
+
+/*
+** Point *ppIns at an INSERT statement on db for collection zName, and
+** return it.  *pzIns is the collection that *ppIns writes.  The last
+** statement is kept, since consecutive documents nearly always go to the
+** same collection.
+*/
+static sqlite3_stmt *asyncInsertSql(
+  sqlite3 *db,                   /* Connection that writes the document */
+  sqlite3_stmt **ppIns,          /* IN/OUT: The INSERT statement */
+  char **pzIns,                  /* IN/OUT: The collection it writes */
+  const char *zName              /* Collection to write */
+){
+  char *zSql;
+  if( *ppIns && strcmp(*pzIns, zName)==0 ){
+    return *ppIns;
+  }
+  sqlite3_finalize(*ppIns);
+  *ppIns = 0;
+  xjd1_free(*pzIns);
+  *pzIns = xjd1PoolDup(0, zName, -1);
+  if( *pzIns==0 ) return 0;
+  zSql = sqlite3_mprintf("INSERT INTO \"%w\" VALUES(?1)", zName);
+  if( zSql==0 ) return 0;
+  sqlite3_prepare_v2(db, zSql, -1, ppIns, 0);
+  sqlite3_free(zSql);
+  return *ppIns;
+}
+
+#if ASYNC_THREAD
+/*
+** A document in the ring of a writer thread.
+*/
+typedef struct AsyncSlot AsyncSlot;
+struct AsyncSlot {
+  char *zText;             /* Collection name, a zero, then the document */
+  int nDoc;                /* Bytes of document text after the name */
+  i64 iTime;               /* When it was queued, in ms */
+};
+
+/*
+** A writer thread.  The connection adds documents to the ring and the
+** thread removes them once they are written.
+*/
+struct AsyncWriter {
+  pthread_t id;                     /* The thread */
+  pthread_mutex_t mutex;            /* Guards the fields that follow */
+  pthread_cond_t cond;              /* Broadcast when they change */
+  AsyncSlot aSlot[XJD1_ASYNC_RING]; /* The ring */
+  int iTail;                        /* aSlot[iTail] is the oldest document */
+  int nUsed;                        /* Documents in the ring */
+  int mxDoc;                        /* Copy of AsyncQueue.mxDoc */
+  int msWindow;                     /* Copy of AsyncQueue.msWindow */
+  int nDrain;                       /* Threads waiting for an empty ring */
+  u8 isStop;                        /* True when the thread should exit */
+  int rc;                           /* Error not yet reported, or XJD1_OK */
+  char *zErr;                       /* Error message for rc */
+  /* Only used by the thread, or after it exits */
+  sqlite3 *db;                      /* The connection that writes */
+  sqlite3_stmt *pIns;               /* INSERT for collection zIns */
+  char *zIns;                       /* Collection that pIns writes */
+};
+
+/*
+** Write the n oldest documents of the ring of pW as one transaction.  The
+** mutex is not held, but the connection does not touch these slots until
+** they are released.  Return XJD1_OK, or XJD1_ERROR after setting *pzErr
+** to a message obtained from sqlite3_malloc().
+*/
+static int asyncWriterWrite(AsyncWriter *pW, int n, char **pzErr){
+  const char *zName = 0;
+  int rc;
+  int i;
+
+  rc = sqlite3_exec(pW->db, "BEGIN", 0, 0, 0);
+  for(i=0; rc==SQLITE_OK && i<n; i++){
+    AsyncSlot *p = &pW->aSlot[(pW->iTail+i)%XJD1_ASYNC_RING];
+    sqlite3_stmt *pIns;
+    zName = p->zText;
+    pIns = asyncInsertSql(pW->db, &pW->pIns, &pW->zIns, zName);
+    if( pIns==0 ){
+      rc = SQLITE_ERROR;
+    }else{
+      sqlite3_bind_text(pIns, 1, &zName[strlen(zName)+1], p->nDoc,
+                        SQLITE_STATIC);
+      if( sqlite3_step(pIns)!=SQLITE_DONE ) rc = SQLITE_ERROR;
+      sqlite3_reset(pIns);
+    }
+  }
+  if( rc==SQLITE_OK ) rc = sqlite3_exec(pW->db, "COMMIT", 0, 0, 0);
+  if( pW->pIns ) sqlite3_clear_bindings(pW->pIns);
+  if( rc==SQLITE_OK ) return XJD1_OK;
+  if( zName ){
+    *pzErr = sqlite3_mprintf("async insert into %s failed: %s",
+                             zName, sqlite3_errmsg(pW->db));
+  }else{
+    *pzErr = sqlite3_mprintf("async insert failed: %s",
+                             sqlite3_errmsg(pW->db));
+  }
+  if( !sqlite3_get_autocommit(pW->db) ){
+    sqlite3_exec(pW->db, "ROLLBACK", 0, 0, 0);
+  }
+  return XJD1_ERROR;
+}
+
+/*
+** Return true if the writer thread should write the ring now, or exit if
+** the ring is empty.  Otherwise wait until something changes, or until
+** the oldest document falls due, and return false.  The mutex is held.
+*/
+static int asyncWriterReady(AsyncWriter *pW){
+  i64 iDue, iNow;
+  struct timespec t;
+  if( pW->nUsed==0 ){
+    if( pW->isStop ) return 1;
+    pthread_cond_wait(&pW->cond, &pW->mutex);
+    return 0;
+  }
+  if( pW->isStop || pW->nDrain>0 || pW->nUsed>=pW->mxDoc
+   || pW->nUsed>=XJD1_ASYNC_RING
+  ){
+    return 1;
+  }
+  if( pW->msWindow<=0 ){
+    pthread_cond_wait(&pW->cond, &pW->mutex);
+    return 0;
+  }
+  iDue = pW->aSlot[pW->iTail].iTime + pW->msWindow;
+  iNow = asyncNow();
+  if( iNow>=iDue ) return 1;
+  clock_gettime(CLOCK_REALTIME, &t);
+  iDue = t.tv_sec*(i64)1000000000 + t.tv_nsec + (iDue-iNow)*1000000;
+  t.tv_sec = iDue/1000000000;
+  t.tv_nsec = iDue%1000000000;
+  pthread_cond_timedwait(&pW->cond, &pW->mutex, &t);
+  return 0;
+}
+
+/*
+** The writer thread.
+*/
+static void *asyncWriterMain(void *pArg){
+  AsyncWriter *pW = (AsyncWriter*)pArg;
+  pthread_mutex_lock(&pW->mutex);
+  for(;;){
+    char *zErr = 0;
+    int n, rc, i;
+    while( !asyncWriterReady(pW) ){}
+    n = pW->nUsed;
+    if( n==0 ) break;
+    pthread_mutex_unlock(&pW->mutex);
+    rc = asyncWriterWrite(pW, n, &zErr);
+    pthread_mutex_lock(&pW->mutex);
+    for(i=0; i<n; i++){
+      AsyncSlot *p = &pW->aSlot[pW->iTail];
+      xjd1_free(p->zText);
+      p->zText = 0;
+      pW->iTail = (pW->iTail+1)%XJD1_ASYNC_RING;
+    }
+    pW->nUsed -= n;
+    if( rc && pW->rc==XJD1_OK ){
+      pW->rc = rc;
+      pW->zErr = zErr;
+    }else{
+      sqlite3_free(zErr);
+    }
+    pthread_cond_broadcast(&pW->cond);
+  }
+  pthread_mutex_unlock(&pW->mutex);
+  return 0;
+}
+
+/*
+** Start the writer thread of pConn, if it may have one.  Return the
+** writer, or NULL if the queue of the connection must be used instead.
+** Only one attempt is made.
+*/
+static AsyncWriter *asyncWriterStart(xjd1 *pConn){
+  AsyncQueue *pQ = &pConn->sAsync;
+  AsyncWriter *pW;
+  sqlite3_stmt *pList = 0;
+  const char *zFile;
+  int rc;
+
+  if( pQ->noWriter ) return 0;
+  pQ->noWriter = 1;
+  if( !xjd1_threadsafe() || !xjd1ContextWal(pConn->pContext) ) return 0;
+  pW = xjd1_malloc( sizeof(*pW) );
+  if( pW==0 ) return 0;
+  memset(pW, 0, sizeof(*pW));
+
+  /* The file of the main database.  It is an empty string for an
+  ** in-memory or temporary database, which no other connection can
+  ** open. */
+  sqlite3_prepare_v2(pConn->db, "PRAGMA database_list", -1, &pList, 0);
+  if( pList==0 || sqlite3_step(pList)!=SQLITE_ROW ){
+    zFile = 0;
+  }else{
+    zFile = (const char*)sqlite3_column_text(pList, 2);
+  }
+  if( zFile==0 || zFile[0]==0 ){
+    rc = SQLITE_ERROR;
+  }else{
+    rc = sqlite3_open_v2(zFile, &pW->db,
+                         SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, 0);
+  }
+  sqlite3_finalize(pList);
+  if( rc!=SQLITE_OK ){
+    sqlite3_close(pW->db);
+    xjd1_free(pW);
+    return 0;
+  }
+  sqlite3_busy_timeout(pW->db, XJD1_DEFAULT_BUSY_TIMEOUT);
+  pthread_mutex_init(&pW->mutex, 0);
+  pthread_cond_init(&pW->cond, 0);
+  if( pthread_create(&pW->id, 0, asyncWriterMain, pW) ){
+    pthread_cond_destroy(&pW->cond);
+    pthread_mutex_destroy(&pW->mutex);
+    sqlite3_close(pW->db);
+    xjd1_free(pW);
+    return 0;
+  }
+  pQ->pWriter = pW;
+  return pW;
+}
+
+/*
+** Move an error of the writer thread of pConn, if there is one, to the
+** connection and return its code.  The mutex is held.
+*/
+static int asyncWriterError(xjd1 *pConn, AsyncWriter *pW){
+  int rc = pW->rc;
+  if( rc ){
+    xjd1Error(pConn, rc, "%s", pW->zErr ? pW->zErr : "async insert failed");
+    sqlite3_free(pW->zErr);
+    pW->zErr = 0;
+    pW->rc = XJD1_OK;
+  }
+  return rc;
+}
+
+/*
+** Render pDoc and add it to the ring of the writer thread of pConn, for
+** collection zName.  If an earlier batch failed, report that instead and
+** do not add the document.
+*/
+static int asyncWriterAppend(xjd1 *pConn, const char *zName, JsonNode *pDoc){
+  AsyncQueue *pQ = &pConn->sAsync;
+  AsyncWriter *pW = pQ->pWriter;
+  AsyncSlot *p;
+  String x;
+  int n = xjd1Strlen30(zName) + 1;
+  int rc;
+
+  xjd1StringInit(&x, 0, 0);
+  if( xjd1StringAppend(&x, zName, n)!=n ){
+    xjd1StringClear(&x);
+    xjd1Error(pConn, XJD1_NOMEM, 0);
+    return XJD1_NOMEM;
+  }
+  xjd1JsonRender(&x, pDoc);
+  pthread_mutex_lock(&pW->mutex);
+  rc = asyncWriterError(pConn, pW);
+  if( rc==XJD1_OK ){
+    while( pW->nUsed>=XJD1_ASYNC_RING ){
+      pthread_cond_wait(&pW->cond, &pW->mutex);
+    }
+    p = &pW->aSlot[(pW->iTail+pW->nUsed)%XJD1_ASYNC_RING];
+    p->nDoc = xjd1StringLen(&x) - n;
+    p->zText = x.zBuf;
+    p->iTime = pQ->msWindow>0 ? asyncNow() : 0;
+    pW->mxDoc = pQ->mxDoc;
+    pW->msWindow = pQ->msWindow;
+    pW->nUsed++;
+    if( pW->nUsed==1 || pW->nUsed>=pW->mxDoc ){
+      pthread_cond_broadcast(&pW->cond);
+    }
+    pQ->nSent++;
+  }else{
+    xjd1StringClear(&x);
+  }
+  pthread_mutex_unlock(&pW->mutex);
+  return rc;
+}
+
+/*
+** Wait until the writer thread of pConn has written every document
+** given to it, then report any error it had.
+*/
+static int asyncWriterDrain(xjd1 *pConn){
+  AsyncQueue *pQ = &pConn->sAsync;
+  AsyncWriter *pW = pQ->pWriter;
+  int rc;
+  pthread_mutex_lock(&pW->mutex);
+  if( pW->nUsed>0 ){
+    pW->nDrain++;
+    pthread_cond_broadcast(&pW->cond);
+    while( pW->nUsed>0 ) pthread_cond_wait(&pW->cond, &pW->mutex);
+    pW->nDrain--;
+  }
+  rc = asyncWriterError(pConn, pW);
+  pthread_mutex_unlock(&pW->mutex);
+  pQ->nSent = 0;
+  return rc;
+}
+
+/*
+** Report an error of the writer thread of pConn, without waiting.
+*/
+static int asyncWriterPoll(xjd1 *pConn){
+  AsyncWriter *pW = pConn->sAsync.pWriter;
+  int rc;
+  pthread_mutex_lock(&pW->mutex);
+  rc = asyncWriterError(pConn, pW);
+  pthread_mutex_unlock(&pW->mutex);
+  return rc;
+}
+
+/*
+** Stop the writer thread of a connection that is closing and free it.
+** Documents still in the ring are written first.
+*/
+static void asyncWriterStop(AsyncWriter *pW){
+  pthread_mutex_lock(&pW->mutex);
+  pW->isStop = 1;
+  pthread_cond_broadcast(&pW->cond);
+  pthread_mutex_unlock(&pW->mutex);
+  pthread_join(pW->id, 0);
+  sqlite3_free(pW->zErr);
+  sqlite3_finalize(pW->pIns);
+  xjd1_free(pW->zIns);
+  sqlite3_close(pW->db);
+  pthread_cond_destroy(&pW->cond);
+  pthread_mutex_destroy(&pW->mutex);
+  xjd1_free(pW);
+}
+#endif /* ASYNC_THREAD */
+
+/*
+** Write every queued document to storage, in a single transaction, and
+** empty the queue.  If there is a writer thread, wait for it to write
+** its documents.  Return XJD1_OK, or an error code after leaving a
+** message in the connection.
+*/
+int xjd1AsyncFlush(xjd1 *pConn){
+  AsyncQueue *pQ = &pConn->sAsync;
+  const char *zText;
+  const char *zName = 0;
+  int isTrans;
+  int rc = XJD1_OK;
+  int i;
+
+#if ASYNC_THREAD
+  if( pQ->nSent>0 ){
+    rc = asyncWriterDrain(pConn);
+    if( rc ) return rc;
+  }
+#endif
+  if( pQ->nDoc==0 ) return XJD1_OK;
+  zText = xjd1StringText(&pQ->sText);
+  isTrans = xjd1TransBegin(pConn);
+  if( isTrans==TRANS_ERROR ){
+    asyncReset(pQ);
+    return XJD1_ERROR;
+  }
+  for(i=0; rc==XJD1_OK && i<pQ->nDoc; i++){
+    AsyncDoc *pDoc = &pQ->aDoc[i];
+    sqlite3_stmt *pIns;
+    zName = &zText[pDoc->iName];
+    pIns = asyncInsertSql(pConn->db, &pQ->pIns, &pQ->zIns, zName);
+    if( pIns==0 ){
+      rc = XJD1_ERROR;
+    }else{
+      sqlite3_bind_text(pIns, 1, &zText[pDoc->iDoc], pDoc->nDoc,
+                        SQLITE_STATIC);
+      if( sqlite3_step(pIns)!=SQLITE_DONE ) rc = XJD1_ERROR;
+      sqlite3_reset(pIns);
+    }
+  }
+  if( rc!=XJD1_OK ){
+    xjd1Error(pConn, XJD1_ERROR, "async insert into %s failed: %s",
+              zName, sqlite3_errmsg(pConn->db));
+  }
+  if( pQ->pIns ) sqlite3_clear_bindings(pQ->pIns);
+  asyncReset(pQ);
+  return xjd1TransEnd(pConn, isTrans, rc);
+}
+
+/*
+** Write the queue if its oldest document has waited more than msWindow
+** milliseconds, and report an error of the writer thread.  Return
+** XJD1_OK or an error code.
+*/
+int xjd1AsyncPoll(xjd1 *pConn){
+  AsyncQueue *pQ = &pConn->sAsync;
+#if ASYNC_THREAD
+  if( pQ->nSent>0 ){
+    int rc = asyncWriterPoll(pConn);
+    if( rc ) return rc;
+  }
+#endif
+  if( pQ->nDoc>0 && pQ->msWindow>0
+   && asyncNow() - pQ->iFirst >= pQ->msWindow
+  ){
+    return xjd1AsyncFlush(pConn);
+  }
+  return XJD1_OK;
+}
+
+/*
+** Render pDoc and add it to the queue for collection zName, or give it
+** to the writer thread.  The queue is written if this fills it.  Return
+** XJD1_OK or an error code.
+*/
+int xjd1AsyncAppend(xjd1 *pConn, const char *zName, JsonNode *pDoc){
+  AsyncQueue *pQ = &pConn->sAsync;
+  AsyncDoc *p;
+  int rc = XJD1_OK;
+
+#if ASYNC_THREAD
+  /* Documents of an open transaction must be written by the connection
+  ** that holds it. */
+  if( xjd1TransDepth(pConn)==0
+   && (pQ->pWriter || asyncWriterStart(pConn))
+  ){
+    return asyncWriterAppend(pConn, zName, pDoc);
+  }
+#endif
+
+  if( pQ->nDoc>=pQ->nAlloc ){
+    int nNew = pQ->nAlloc*2 + 64;
+    AsyncDoc *aNew = xjd1_realloc(pQ->aDoc, nNew*sizeof(AsyncDoc));
+    if( aNew==0 ) goto async_nomem;
+    pQ->aDoc = aNew;
+    pQ->nAlloc = nNew;
+  }
+  p = &pQ->aDoc[pQ->nDoc];
+  if( pQ->iLastName<0
+   || strcmp(&xjd1StringText(&pQ->sText)[pQ->iLastName], zName)!=0
+  ){
+    int n = xjd1Strlen30(zName) + 1;
+    pQ->iLastName = xjd1StringLen(&pQ->sText);
+    if( xjd1StringAppend(&pQ->sText, zName, n)!=n ) goto async_nomem;
+  }
+  p->iName = pQ->iLastName;
+  p->iDoc = xjd1StringLen(&pQ->sText);
+  xjd1JsonRender(&pQ->sText, pDoc);
+  p->nDoc = xjd1StringLen(&pQ->sText) - p->iDoc;
+  if( pQ->nDoc==0 && pQ->msWindow>0 ) pQ->iFirst = asyncNow();
+  pQ->nDoc++;
+  if( pQ->nDoc>=pQ->mxDoc ) rc = xjd1AsyncFlush(pConn);
+  return rc;
+
+async_nomem:
+  xjd1Error(pConn, XJD1_NOMEM, 0);
+  return XJD1_NOMEM;
+}
+
+/*
+** Write every document queued by ASYNC INSERT statements on pConn.
+*/
+int xjd1_flush(xjd1 *pConn){
+  if( pConn==0 || pConn->isDying ) return XJD1_MISUSE;
+  return xjd1AsyncFlush(pConn);
+}
+
+/*
+** Free the queue of a connection that is closing.  Documents still
+** queued are discarded.  The writer thread writes the documents it
+** holds and exits.
+*/
+void xjd1AsyncClear(xjd1 *pConn){
+  AsyncQueue *pQ = &pConn->sAsync;
+#if ASYNC_THREAD
+  if( pQ->pWriter ) asyncWriterStop(pQ->pWriter);
+#endif
+  sqlite3_finalize(pQ->pIns);
+  xjd1_free(pQ->zIns);
+  xjd1_free(pQ->aDoc);
+  xjd1StringClear(&pQ->sText);
+  memset(pQ, 0, sizeof(*pQ));
+}
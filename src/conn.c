@@ -18,19 +18,44 @@
 */
 #include "xjd1Int.h"
 
+/*
+** Return true if the library is safe to use from more than one thread.
+*/
+int xjd1_threadsafe(void){
+  return sqlite3_threadsafe()!=0;
+}
+
 /*
 ** Open a new database connection
+**
+** A connection is only ever used by one thread at a time, so the storage
+** engine is asked not to serialize access to it.  Separate connections
+** in separate threads then share no locks other than those on the
+** database file.  In WAL mode, readers do not wait for the writer, nor
+** the writer for readers.
 */
 int xjd1_open(xjd1_context *pContext, const char *zURI, xjd1 **ppNewConn){
   xjd1 *pConn;
   int rc;
 
+  xjd1JsonInit();
   *ppNewConn = pConn = xjd1_malloc( sizeof(*pConn) );
   if( pConn==0 ) return XJD1_NOMEM;
   memset(pConn, 0, sizeof(*pConn));
   pConn->pContext = pContext;
+  xjd1ContextRef(pContext);
+  pConn->mxCache = XJD1_DEFAULT_STMTCACHE;
+  pConn->mxWriteBuf = XJD1_DEFAULT_WRITEBUF;
+  xjd1AsyncInit(pConn);
   rc = sqlite3_open_v2(zURI, &pConn->db, 
-            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, 0);
+            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI |
+            SQLITE_OPEN_NOMUTEX, 0);
+  if( rc==SQLITE_OK ){
+    sqlite3_busy_timeout(pConn->db, XJD1_DEFAULT_BUSY_TIMEOUT);
+    if( xjd1ContextWal(pContext) ){
+      rc = sqlite3_exec(pConn->db, "PRAGMA journal_mode=WAL", 0, 0, 0);
+    }
+  }
   if( rc ){
     xjd1Error(pConn, XJD1_ERROR, "%s", sqlite3_errmsg(pConn->db));
     sqlite3_close(pConn->db);
@@ -52,6 +77,43 @@ int xjd1_config(xjd1 *pConn, int op, ...){
       rc = XJD1_OK;
       break;
     }
+    case XJD1_CONFIG_STMTCACHE: {
+      int mx = va_arg(ap, int);
+      if( mx>=0 ){
+        xjd1StmtCacheFlush(pConn);
+        pConn->mxCache = mx;
+      }
+      rc = XJD1_OK;
+      break;
+    }
+    case XJD1_CONFIG_STMTCACHE_STAT: {
+      int *pnHit = va_arg(ap, int*);
+      int *pnMiss = va_arg(ap, int*);
+      if( pnHit ) *pnHit = pConn->nCacheHit;
+      if( pnMiss ) *pnMiss = pConn->nCacheMiss;
+      rc = XJD1_OK;
+      break;
+    }
+    case XJD1_CONFIG_WRITEBUF: {
+      int mx = va_arg(ap, int);
+      if( mx>=0 ) pConn->mxWriteBuf = mx;
+      rc = XJD1_OK;
+      break;
+    }
+    case XJD1_CONFIG_ASYNC: {
+      int mxDoc = va_arg(ap, int);
+      int msWindow = va_arg(ap, int);
+      if( mxDoc>=0 ) pConn->sAsync.mxDoc = mxDoc;
+      if( msWindow>=0 ) pConn->sAsync.msWindow = msWindow;
+      rc = xjd1AsyncFlush(pConn);
+      break;
+    }
+    case XJD1_CONFIG_TRANSACTION: {
+      int *pnTrans = va_arg(ap, int*);
+      if( pnTrans ) *pnTrans = xjd1TransDepth(pConn);
+      rc = XJD1_OK;
+      break;
+    }
     default: {
       break;
     }
@@ -63,16 +125,26 @@ int xjd1_config(xjd1 *pConn, int op, ...){
 /* Close a database connection.  The close does not actually
 ** occur until all references to the connection also close.  This
 ** means that any prepared statements must also be closed.
+**
+** Documents queued by ASYNC INSERT are written first.  If they cannot
+** be, the connection is closed anyway and the error code is returned.
 */
 int xjd1_close(xjd1 *pConn){
+  int rc = XJD1_OK;
   if( pConn==0 ) return XJD1_OK;
+  if( !pConn->isDying ){
+    rc = xjd1AsyncFlush(pConn);
+    xjd1StmtCacheFlush(pConn);
+  }
   pConn->isDying = 1;
-  if( pConn->nRef>0 ) return XJD1_OK;
+  if( pConn->nRef>0 ) return rc;
   xjd1ContextUnref(pConn->pContext);
+  xjd1TransClear(pConn);
+  xjd1AsyncClear(pConn);
   sqlite3_close(pConn->db);
   xjd1StringClear(&pConn->errMsg);
   xjd1_free(pConn);
-  return XJD1_OK;
+  return rc;
 }
 
 /*
@@ -18,6 +18,12 @@
 */
 #include "xjd1Int.h"
 
+/*
+** A context may be shared by connections that are used by different
+** threads.  Its reference count and settings are guarded by a mutex.
+** In a single-threaded build, sqlite3_mutex_alloc() returns NULL and the
+** mutex calls do nothing.
+*/
 
 int xjd1_context_new(xjd1_context **ppNew){
   xjd1_context *p;
@@ -25,24 +31,75 @@ int xjd1_context_new(xjd1_context **ppNew){
   *ppNew = p = xjd1_malloc( sizeof(*p) );
   if( p ){
     memset(p, 0, sizeof(*p));
+    p->pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
     return XJD1_OK;
   }else{
     return XJD1_NOMEM;
   }
 }
 int xjd1_context_config(xjd1_context *p, int op, ...){
-  return XJD1_UNKNOWN;
+  int rc = XJD1_UNKNOWN;
+  va_list ap;
+  va_start(ap, op);
+  sqlite3_mutex_enter(p->pMutex);
+  switch( op ){
+    case XJD1_CONTEXT_LOG: {
+      p->xLog = va_arg(ap, int(*)(const char*,void*));
+      p->pLogArg = va_arg(ap, void*);
+      rc = XJD1_OK;
+      break;
+    }
+    case XJD1_CONTEXT_WAL: {
+      p->isWal = va_arg(ap, int)!=0;
+      rc = XJD1_OK;
+      break;
+    }
+  }
+  sqlite3_mutex_leave(p->pMutex);
+  va_end(ap);
+  return rc;
 }
 int xjd1_context_delete(xjd1_context *p){
+  int nRef;
   if( p==0 ) return XJD1_OK;
+  sqlite3_mutex_enter(p->pMutex);
   p->isDying = 1;
-  if( p->nRef>0 ) return XJD1_OK;
+  nRef = p->nRef;
+  sqlite3_mutex_leave(p->pMutex);
+  if( nRef>0 ) return XJD1_OK;
+  sqlite3_mutex_free(p->pMutex);
   xjd1_free(p);
   return XJD1_OK;
 }
 
+/*
+** Add a reference to a context, for a connection that uses it.
+*/
+PRIVATE void xjd1ContextRef(xjd1_context *p){
+  if( p==0 ) return;
+  sqlite3_mutex_enter(p->pMutex);
+  p->nRef++;
+  sqlite3_mutex_leave(p->pMutex);
+}
+
 PRIVATE void xjd1ContextUnref(xjd1_context *p){
+  int isLast;
   if( p==0 ) return;
+  sqlite3_mutex_enter(p->pMutex);
   p->nRef--;
-  if( p->nRef<=0 && p->isDying ) xjd1_context_delete(p);
+  isLast = p->nRef<=0 && p->isDying;
+  sqlite3_mutex_leave(p->pMutex);
+  if( isLast ) xjd1_context_delete(p);
+}
+
+/*
+** Return true if connections opened in context p should use WAL mode.
+*/
+PRIVATE int xjd1ContextWal(xjd1_context *p){
+  int isWal;
+  if( p==0 ) return 0;
+  sqlite3_mutex_enter(p->pMutex);
+  isWal = p->isWal;
+  sqlite3_mutex_leave(p->pMutex);
+  return isWal;
 }
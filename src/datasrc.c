@@ -36,10 +36,31 @@ int xjd1DataSrcInit(DataSrc *p, Query *pQuery, void *pOuterCtx){
       break;
     }
     case TK_ID: {
-      char *zSql = sqlite3_mprintf("SELECT x FROM \"%w\"", p->u.tab.zName);
+      Command *pCmd = pQuery->pStmt->pCmd;
+      int n = xjd1Strlen30(p->u.tab.zName);
+      char *zSql;
+      if( pCmd && pCmd->eCmdType==TK_INSERT
+       && xjd1Strlen30(pCmd->u.ins.zName)==n
+       && sqlite3_strnicmp(pCmd->u.ins.zName, p->u.tab.zName, n)==0
+      ){
+        /* An INSERT ... SELECT that reads the collection it writes.
+        ** Only read the documents that were there when it started. */
+        p->u.tab.isTarget = 1;
+        p->u.tab.needBind = 1;
+        zSql = sqlite3_mprintf("SELECT x FROM \"%w\" WHERE rowid<=?1",
+                               p->u.tab.zName);
+      }else{
+        zSql = sqlite3_mprintf("SELECT x FROM \"%w\"", p->u.tab.zName);
+      }
       sqlite3_prepare_v2(pQuery->pStmt->pConn->db, zSql, -1, 
                          &p->u.tab.pStmt, 0);
       sqlite3_free(zSql);
+      if( p->u.tab.pStmt==0 ){
+        /* The collection does not exist, so it reads as empty.  Do not
+        ** cache the statement, or it would still read as empty after the
+        ** collection is created. */
+        pQuery->pStmt->noCache = 1;
+      }
       break;
     }
     case TK_FLATTENOP: {
@@ -59,31 +80,33 @@ int xjd1DataSrcInit(DataSrc *p, Query *pQuery, void *pOuterCtx){
 
 static JsonNode *newIntValue(int i){
   JsonNode *pRet = xjd1JsonNew(0);
-  pRet->eJType = XJD1_REAL;
-  pRet->u.r = (double)i;
+  pRet->eJType = XJD1_INT;
+  pRet->u.i = i;
   return pRet;
 }
 
-static JsonNode *newStringValue(const char *z){
+static JsonNode *newStringValue(const char *z, int n){
   JsonNode *pRet = xjd1JsonNew(0);
-  pRet->eJType = XJD1_STRING;
-  pRet->u.z = xjd1PoolDup(0, z, -1);
+  xjd1JsonSetString(pRet, z, n);
   return pRet;
 }
 
 /*
 ** Argument pPath is a an expression consisting entirely of TK_ID 
 ** and TK_DOT noddes. e.g. "a.b.c.d". If value pVal contains the
-** identified property, a pointer to the JsonStructElem that contains
+** identified property, a pointer to the structure slot that contains
 ** it is returned. 
 **
 ** If bCreate is not true and object pVal does not contain the specified
 ** property, NULL is returned. Or, if bCreate is true and pVal contains all
 ** but the rightmost component of the path, a new element is added to the 
-** object and a pointer to it returned.
+** object and a pointer to its (empty) slot returned.
+**
+** The returned pointer is only valid until the structure that contains
+** the slot is next modified.
 */
-static JsonStructElem *findStructElem(JsonNode *pVal, Expr *pPath, int bCreate){
-  JsonStructElem *pRet = 0;       /* Return value */
+static JsonNode **findStructSlot(JsonNode *pVal, Expr *pPath, int bCreate){
+  JsonNode **ppRet = 0;           /* Return value */
 
   assert( bCreate==0 || pVal->nRef==1 );
   assert( pPath->eType==TK_ID || pPath->eType==TK_DOT );
@@ -92,10 +115,10 @@ static JsonStructElem *findStructElem(JsonNode *pVal, Expr *pPath, int bCreate){
     JsonNode *p = 0;
     const char *zAs;
     if( pPath->eType==TK_DOT ){
-      JsonStructElem *pElem;
-      pElem = findStructElem(pVal, pPath->u.lvalue.pLeft, bCreate);
-      if( pElem ){
-        p = pElem->pValue;
+      JsonNode **ppSlot;
+      ppSlot = findStructSlot(pVal, pPath->u.lvalue.pLeft, bCreate);
+      if( ppSlot ){
+        p = *ppSlot;
         zAs = pPath->u.lvalue.zId;
       }
     }else{
@@ -104,23 +127,17 @@ static JsonStructElem *findStructElem(JsonNode *pVal, Expr *pPath, int bCreate){
     }
 
     if( p && p->eJType==XJD1_STRUCT ){
-      for(pRet=p->u.st.pFirst; pRet; pRet=pRet->pNext){
-        if( 0==strcmp(pRet->zLabel, zAs) ) break;
-      }
-      if( pRet==0 && bCreate ){
-        pRet = xjd1MallocZero(sizeof(*pRet));
-        pRet->zLabel = xjd1PoolDup(0, zAs, -1);
-        if( p->u.st.pLast ){
-          p->u.st.pLast->pNext = pRet;
-        }else{
-          p->u.st.pFirst = pRet;
-        }
-        p->u.st.pLast = pRet;
+      int i;
+      if( bCreate ) xjd1JsonDropSpan(p);
+      i = xjd1JsonStructFind(p, zAs, -1);
+      if( i<0 && bCreate && xjd1JsonInsert(p, zAs, 0)==XJD1_OK ){
+        i = xjd1JsonStructCount(p) - 1;
       }
+      if( i>=0 ) ppRet = &p->u.st.apValue[i];
     }
   }
 
-  return pRet;
+  return ppRet;
 }
 
 /*
@@ -138,10 +155,7 @@ struct FlattenIter {
   int isRecursive;                /* True for FLATTEN, false for EACH */
   struct FlattenIterElem {
     JsonNode *pVal;               /* Struct or List to iterate through. */
-    union {
-      JsonStructElem *pElem;      /* If pVal->eJType==XJD1_STRUCT */
-      int iElem;                  /* If pVal->eJType==XJD1_ARRAY */
-    } current;
+    int iElem;                    /* 1 + index of current element */
   } aIter[1];
 };
 
@@ -157,12 +171,12 @@ static FlattenIter *flattenIterNew(
   int isRecursive                 /* True for FLATTEN, false for EACH */
 ){
   FlattenIter *pNew = 0;          /* New iterator object */
-  JsonStructElem *pElem;
+  JsonNode **ppSlot;
 
-  pElem = findStructElem(pBase, pPath, 0);
-  if( pElem ){
-    JsonNode *pVal = pElem->pValue;
-    if( pVal->eJType==XJD1_STRUCT || pVal->eJType==XJD1_ARRAY ){
+  ppSlot = findStructSlot(pBase, pPath, 0);
+  if( ppSlot ){
+    JsonNode *pVal = *ppSlot;
+    if( pVal && (pVal->eJType==XJD1_STRUCT || pVal->eJType==XJD1_ARRAY) ){
       pNew = (FlattenIter *)xjd1MallocZero(sizeof(FlattenIter));
       if( pNew ){
         pNew->nAlloc = 1;
@@ -185,9 +199,9 @@ static int flattenIterEntry(
 
   assert( p->pVal->eJType==XJD1_STRUCT || p->pVal->eJType==XJD1_ARRAY );
   if( p->pVal->eJType==XJD1_STRUCT ){
-    *ppVal = xjd1JsonRef(p->current.pElem->pValue);
+    *ppVal = xjd1JsonRef(p->pVal->u.st.apValue[p->iElem-1]);
   }else{
-    *ppVal = xjd1JsonRef(p->pVal->u.ar.apElem[p->current.iElem-1]);
+    *ppVal = xjd1JsonRef(p->pVal->u.ar.apElem[p->iElem-1]);
   }
 
   if( ppKey ){
@@ -205,9 +219,11 @@ static int flattenIterEntry(
     for(i=pIter->nIter-1; i>=0; i--){
       p = &pIter->aIter[i];
       if( p->pVal->eJType==XJD1_STRUCT ){
-        pKey = newStringValue(p->current.pElem->zLabel);
+        JsonShape *pShape = p->pVal->u.st.pShape;
+        pKey = newStringValue(pShape->azLabel[p->iElem-1],
+                              pShape->anLabel[p->iElem-1]);
       }else{
-        pKey = newIntValue(p->current.iElem-1);
+        pKey = newIntValue(p->iElem-1);
       }
       if( pIter->isRecursive==0 ) break;
       pList->u.ar.apElem[i] = pKey;
@@ -224,25 +240,18 @@ static int flattenIterNext(FlattenIter **ppIter){
   if( pIter ){
     while( rc==XJD1_DONE && pIter->nIter ){
       struct FlattenIterElem *p = &(*ppIter)->aIter[pIter->nIter-1];
+      int nElem;
       if( p->pVal->eJType==XJD1_STRUCT ){
-        if( p->current.pElem==0 ){
-          p->current.pElem = p->pVal->u.st.pFirst;
-        }else{
-          p->current.pElem = p->current.pElem->pNext;
-        }
-        if( p->current.pElem ){
-          rc = XJD1_ROW;
-        }else{
-          pIter->nIter--;
-        }
+        nElem = xjd1JsonStructCount(p->pVal);
       }else{
         assert( p->pVal->eJType==XJD1_ARRAY );
-        p->current.iElem++;
-        if( p->current.iElem<=p->pVal->u.ar.nElem ){
-          rc = XJD1_ROW;
-        }else{
-          pIter->nIter--;
-        }
+        nElem = p->pVal->u.ar.nElem;
+      }
+      p->iElem++;
+      if( p->iElem<=nElem ){
+        rc = XJD1_ROW;
+      }else{
+        pIter->nIter--;
       }
 
       if( pIter->isRecursive && rc==XJD1_ROW ){
@@ -261,8 +270,7 @@ static int flattenIterNext(FlattenIter **ppIter){
           }
 
           pIter->aIter[pIter->nIter].pVal = pVal;
-          pIter->aIter[pIter->nIter].current.pElem = 0;
-          pIter->aIter[pIter->nIter].current.iElem = 0;
+          pIter->aIter[pIter->nIter].iElem = 0;
           pIter->nIter++;
           rc = XJD1_DONE;
         }
@@ -319,7 +327,7 @@ static JsonNode *flattenedObject(
 ){
   JsonNode *pRet;                 /* Value to return */
   JsonNode *pKV;                  /* New value for property zAs */
-  JsonStructElem *pElem;
+  JsonNode **ppSlot;
 
   pKV = xjd1JsonNew(0);
   pKV->eJType = XJD1_STRUCT;
@@ -327,14 +335,32 @@ static JsonNode *flattenedObject(
   xjd1JsonInsert(pKV, "v", pValue);
 
   pRet = xjd1JsonEdit(xjd1JsonRef(pBase));
-  pElem = findStructElem(pRet, pPath, 1);
-  xjd1JsonFree(pElem->pValue);
-  pElem->pValue = pKV;
+  ppSlot = findStructSlot(pRet, pPath, 1);
+  if( ppSlot ){
+    xjd1JsonFree(*ppSlot);
+    *ppSlot = pKV;
+  }else{
+    xjd1JsonFree(pKV);
+  }
   
   assert( pRet->nRef==1 && pRet!=pBase );
   return pRet;
 }
 
+/*
+** Return the current value of data source p.  A collection document is
+** parsed here, the first time it is needed, rather than when the row is
+** read.  A query that only copies documents to its output never parses
+** them.
+*/
+static JsonNode *dataSrcValue(DataSrc *p){
+  if( p->eDSType==TK_ID && p->u.tab.zRaw && !p->u.tab.isParsed ){
+    p->pValue = xjd1JsonParse(p->u.tab.zRaw, p->u.tab.nRaw);
+    p->u.tab.isParsed = 1;
+  }
+  return p->pValue;
+}
+
 /*
 ** Advance a data source to the next row. Return XJD1_DONE if the data 
 ** source is at EOF or XJD1_ROW if the step results in a row of content 
@@ -372,16 +398,33 @@ int xjd1DataSrcStep(DataSrc *p){
     }
 
     case TK_ID: {
+      if( p->u.tab.needBind ){
+        sqlite3_bind_int64(p->u.tab.pStmt, 1, p->pQuery->pStmt->iMaxRowid);
+        p->u.tab.needBind = 0;
+      }
       rc = sqlite3_step(p->u.tab.pStmt);
       xjd1JsonFree(p->pValue);
       p->pValue = 0;
+      p->u.tab.isParsed = 0;
+      p->u.tab.zRaw = 0;
       if( rc==SQLITE_ROW ){
-        const char *zJson = (const char*)sqlite3_column_text(p->u.tab.pStmt, 0);
-        p->pValue = xjd1JsonParse(zJson, -1);
+        /* The document is parsed by dataSrcValue() only if something
+        ** looks inside it.  The text stays valid until the next step. */
+        p->u.tab.zRaw = (const char*)sqlite3_column_text(p->u.tab.pStmt, 0);
+        p->u.tab.nRaw = sqlite3_column_bytes(p->u.tab.pStmt, 0);
         rc = XJD1_ROW;
       }else{
         p->u.tab.eofSeen = 1;
-        rc = XJD1_DONE;
+        if( rc!=SQLITE_DONE && p->u.tab.pStmt ){
+          /* A collection that does not exist has no statement, and reads
+          ** as empty.  Any other failure is an error. */
+          xjd1_stmt *pStmt = p->pQuery->pStmt;
+          xjd1Error(pStmt->pConn, XJD1_ERROR, "%s",
+                    sqlite3_errmsg(pStmt->pConn->db));
+          rc = XJD1_ERROR;
+        }else{
+          rc = XJD1_DONE;
+        }
       }
       break;
     }
@@ -399,7 +442,7 @@ int xjd1DataSrcStep(DataSrc *p){
           break;
         }else{
           int isRecursive = (p->u.flatten.cOpName=='F');
-          JsonNode *pBase = p->u.flatten.pNext->pValue;
+          JsonNode *pBase = dataSrcValue(p->u.flatten.pNext);
           Expr *pPath = p->u.flatten.pExpr;
 
           p->u.flatten.pIter = flattenIterNew(pBase, pPath, isRecursive);
@@ -409,7 +452,7 @@ int xjd1DataSrcStep(DataSrc *p){
       if( rc==XJD1_ROW ){
         JsonNode *pKey = 0;
         JsonNode *pValue = 0;
-        JsonNode *pBase = p->u.flatten.pNext->pValue;
+        JsonNode *pBase = dataSrcValue(p->u.flatten.pNext);
         flattenIterEntry(p->u.flatten.pIter, &pKey, &pValue);
         p->pValue = flattenedObject(pBase, pKey, pValue, p->u.flatten.pAs);
       }
@@ -458,7 +501,7 @@ JsonNode *xjd1DataSrcDoc(DataSrc *p, const char *zDocName){
   JsonNode *pRes = 0;
   if( p==0 ) return 0;
   if( zDocName && p->zAs && 0==strcmp(p->zAs, zDocName) ){
-    return xjd1JsonRef(p->pValue);
+    return xjd1JsonRef(dataSrcValue(p));
   }
   switch( p->eDSType ){
     case TK_COMMA: {
@@ -469,19 +512,19 @@ JsonNode *xjd1DataSrcDoc(DataSrc *p, const char *zDocName){
     case TK_SELECT: {
       assert( p->zAs );
       if( zDocName==0 ){
-        pRes = xjd1JsonRef(p->pValue);
+        pRes = xjd1JsonRef(dataSrcValue(p));
       }
       break;
     }
     case TK_FLATTENOP:
     case TK_ID: {
       if( zDocName==0 || (p->zAs==0 && strcmp(p->u.tab.zName, zDocName)==0) ){
-        pRes = xjd1JsonRef(p->pValue);
+        pRes = xjd1JsonRef(dataSrcValue(p));
       }
       break;
     }
     default: {
-      pRes = xjd1JsonRef(p->pValue);
+      pRes = xjd1JsonRef(dataSrcValue(p));
       break;
     }
   }
@@ -508,6 +551,9 @@ int xjd1DataSrcRewind(DataSrc *p){
     }
     case TK_ID: {
       sqlite3_reset(p->u.tab.pStmt);
+      p->u.tab.needBind = p->u.tab.isTarget;
+      p->u.tab.zRaw = 0;
+      p->u.tab.isParsed = 0;
       break;
     }
     case TK_DOT: {
@@ -539,6 +585,8 @@ int xjd1DataSrcClose(DataSrc *p){
   switch( p->eDSType ){
     case TK_ID: {
       sqlite3_finalize(p->u.tab.pStmt);
+      p->u.tab.zRaw = 0;
+      p->u.tab.isParsed = 0;
       break;
     }
     case TK_FLATTENOP: {
@@ -568,7 +616,7 @@ static void cacheSaveRecursive(DataSrc *p, JsonNode ***papNode){
     cacheSaveRecursive(p->u.join.pRight, papNode);
   }else{
     xjd1JsonFree(**papNode);
-    **papNode = xjd1JsonRef(p->pValue);
+    **papNode = xjd1JsonRef(dataSrcValue(p));
     (*papNode)++;
   }
 }
@@ -619,7 +667,7 @@ static JsonNode *datasrcReadRecursive(
     }
   }else{
     if( *piEntry==iDoc ){
-      pRet = xjd1JsonRef(p->pValue);
+      pRet = xjd1JsonRef(dataSrcValue(p));
     }
     (*piEntry)++;
   }
@@ -630,3 +678,39 @@ JsonNode *xjd1DataSrcRead(DataSrc *p, int iDoc){
   assert( iDoc>=1 );
   return datasrcReadRecursive(p, &iEntry, iDoc);
 }
+
+static int datasrcRawRecursive(
+  DataSrc *p, 
+  int *piEntry, 
+  int iDoc,
+  const char **pzRaw,
+  int *pnRaw
+){
+  int ret = 0;
+  if( p->eDSType==TK_COMMA ){
+    ret = datasrcRawRecursive(p->u.join.pLeft, piEntry, iDoc, pzRaw, pnRaw);
+    if( 0==ret ){
+      ret = datasrcRawRecursive(p->u.join.pRight, piEntry, iDoc, pzRaw, pnRaw);
+    }
+  }else{
+    if( *piEntry==iDoc && p->eDSType==TK_ID && p->u.tab.zRaw ){
+      *pzRaw = p->u.tab.zRaw;
+      *pnRaw = p->u.tab.nRaw;
+      ret = 1;
+    }
+    (*piEntry)++;
+  }
+  return ret;
+}
+
+/*
+** If document iDoc of data source p is a document read unchanged from a
+** collection, set *pzRaw and *pnRaw to its stored text and return true.
+** The text is valid until the data source is next stepped.  Otherwise
+** return false.
+*/
+int xjd1DataSrcRaw(DataSrc *p, int iDoc, const char **pzRaw, int *pnRaw){
+  int iEntry = 1;
+  assert( iDoc>=1 );
+  return datasrcRawRecursive(p, &iEntry, iDoc, pzRaw, pnRaw);
+}
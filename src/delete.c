@@ -19,52 +19,57 @@
 #include "xjd1Int.h"
 
 /*
-** Evaluate a pragma.
+** Slots in xjd1_stmt.apSql[] used by DELETE.  The WriteBuf uses slots
+** XJD1_SQL_WRITEBUF and above.
+*/
+#define DELETE_SQL_QUERY   0    /* Scan the collection */
+#define DELETE_SQL_ALL     1    /* Delete everything */
+
+/*
+** Evaluate a DELETE.
 **
-** Unknown pragmas are silently ignored.
+** Rowids of documents that match the WHERE clause are collected in a
+** WriteBuf while the collection is scanned, and deleted in batches
+** after the scan.  The whole statement runs inside a single transaction,
+** or a savepoint if a transaction is already open.
 */
 int xjd1DeleteStep(xjd1_stmt *pStmt){
   Command *pCmd = pStmt->pCmd;
   int rc = XJD1_OK;
-  sqlite3 *db;
-  sqlite3_stmt *pQuery = 0;
-  sqlite3_stmt *pIns = 0;
-  char *zSql;
+  sqlite3_stmt *pQuery;
+  const char *zName;
+  WriteBuf buf;
+  int isTrans;
   
   assert( pCmd!=0 );
   assert( pCmd->eCmdType==TK_DELETE );
-  db = pStmt->pConn->db;
+  zName = pCmd->u.del.zName;
   if( pCmd->u.del.pWhere==0 ){
-    zSql = sqlite3_mprintf("DELETE FROM \"%w\"", pCmd->u.del.zName);
-    sqlite3_exec(db, zSql, 0, 0, 0);
-    sqlite3_free(zSql);
+    pQuery = xjd1StmtSql(pStmt, DELETE_SQL_ALL, "DELETE FROM \"%w\"", zName);
+    if( pQuery ){
+      sqlite3_step(pQuery);
+      sqlite3_reset(pQuery);
+    }
     return XJD1_OK;
   }
-  sqlite3_exec(db, "BEGIN; CREATE TEMP TABLE _t1(x INTEGER PRIMARY KEY)",
-               0, 0, 0);
-  zSql = sqlite3_mprintf("SELECT rowid, x FROM \"%w\"", pCmd->u.del.zName);
-  sqlite3_prepare_v2(db, zSql, -1, &pQuery, 0);
-  sqlite3_prepare_v2(db, "INSERT INTO _t1(x) VALUES(?1)", -1, &pIns, 0);
+  isTrans = xjd1TransBegin(pStmt->pConn);
+  if( isTrans==TRANS_ERROR ) return XJD1_ERROR;
+  xjd1WriteBufInit(&buf, pStmt, zName, 0);
+  pQuery = xjd1StmtSql(pStmt, DELETE_SQL_QUERY,
+                       "SELECT rowid, x FROM \"%w\"", zName);
   if( pQuery ){
-    while( SQLITE_ROW==sqlite3_step(pQuery) ){
+    while( rc==XJD1_OK && SQLITE_ROW==sqlite3_step(pQuery) ){
       const char *zJson = (const char*)sqlite3_column_text(pQuery, 1);
       pStmt->pDoc = xjd1JsonParse(zJson, -1);
       if( xjd1ExprTrue(pCmd->u.del.pWhere) ){
-        sqlite3_bind_int64(pIns, 1, sqlite3_column_int64(pQuery, 0));
-        sqlite3_step(pIns);
-        sqlite3_reset(pIns);
+        rc = xjd1WriteBufAdd(&buf, sqlite3_column_int64(pQuery, 0), 0, 0);
       }
       xjd1JsonFree(pStmt->pDoc);
       pStmt->pDoc = 0;
     }
+    sqlite3_reset(pQuery);
+    if( rc==XJD1_OK ) rc = xjd1WriteBufApply(&buf);
   }
-  sqlite3_finalize(pQuery);
-  sqlite3_finalize(pIns);
-  sqlite3_free(zSql);
-  zSql = sqlite3_mprintf(
-            "DELETE FROM \"%w\" WHERE rowid IN _t1;"
-            "DROP TABLE _t1; COMMIT", pCmd->u.del.zName);
-  sqlite3_exec(db, zSql, 0, 0, 0);
-  sqlite3_free(zSql);
-  return rc;
+  xjd1WriteBufClear(&buf);
+  return xjd1TransEnd(pStmt->pConn, isTrans, rc);
 }
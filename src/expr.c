@@ -109,7 +109,8 @@ static int exprResolve(Expr *p, ResolveCtx *pCtx){
       if( 0==strcmp(zDoc, pCmd->u.update.zName) ) return XJD1_OK;
       break;
 
-    case TK_SELECT: {
+    case TK_SELECT:
+    case TK_INSERT: {
       ResolveCtx *pTest;
       for(pTest=pCtx; pTest; pTest=pTest->pParent){
         Query *pQuery = pTest->pQuery;
@@ -269,11 +270,70 @@ static int isStr(const JsonNode *p){
     case XJD1_FALSE:
     case XJD1_NULL:
     case XJD1_REAL:
+    case XJD1_INT:
       return 0;
   }
   return 1;
 }
 
+/*
+** Return true if the JSON object is an integer
+*/
+static int isInt(const JsonNode *p){
+  return p!=0 && p->eJType==XJD1_INT;
+}
+
+/*
+** Compute iLeft OP iRight, where OP is TK_PLUS, TK_MINUS or TK_STAR.
+** Write the result into *piOut and return 0, or return 1 without
+** writing anything if the result does not fit in 64 bits.
+*/
+static int intArith(int op, i64 iLeft, i64 iRight, i64 *piOut){
+  switch( op ){
+    case TK_PLUS: {
+      if( iRight>=0 ? iLeft>LARGEST_INT64-iRight
+                    : iLeft<SMALLEST_INT64-iRight ) return 1;
+      *piOut = iLeft + iRight;
+      break;
+    }
+    case TK_MINUS: {
+      if( iRight>=0 ? iLeft<SMALLEST_INT64+iRight
+                    : iLeft>LARGEST_INT64+iRight ) return 1;
+      *piOut = iLeft - iRight;
+      break;
+    }
+    default: {
+      i64 iProd;
+      assert( op==TK_STAR );
+      if( iLeft==0 || iRight==0 ){
+        *piOut = 0;
+        break;
+      }
+      if( (iLeft==-1 && iRight==SMALLEST_INT64)
+       || (iRight==-1 && iLeft==SMALLEST_INT64)
+      ){
+        return 1;
+      }
+      iProd = (i64)((u64)iLeft * (u64)iRight);
+      if( iProd/iRight!=iLeft ) return 1;
+      *piOut = iProd;
+      break;
+    }
+  }
+  return 0;
+}
+
+/*
+** Shift v left by n bits, or right by -n bits if n is negative.  n must
+** be between -64 and 64 inclusive.  Right shifts preserve the sign.
+*/
+static i64 shiftLeft(i64 v, i64 n){
+  if( n>=64 ) return 0;
+  if( n<=-64 ) return v<0 ? -1 : 0;
+  if( n>=0 ) return (i64)((u64)v << n);
+  return v >> -n;
+}
+
 /*
 ** Return non-zero if the JSON object passed should be considered TRUE in a 
 ** boolean context. For example in the result of a WHERE or HAVING clause.
@@ -294,8 +354,12 @@ static int isTrue(const JsonNode *p){
       res = p->u.r!=0.0;
       break;
 
+    case XJD1_INT: 
+      res = p->u.i!=0;
+      break;
+
     case XJD1_STRING: 
-      res = p->u.z[0]!='\0';
+      res = xjd1JsonStrLen(p)>0;
       break;
 
     case XJD1_ARRAY:
@@ -324,19 +388,48 @@ static JsonNode *nullJson(void){
 ** If zProperty is not defined, or if pStruct is not of type XJD1_STRUCT,
 ** return a pointer to a NULL value.
 */
-static JsonNode *getProperty(JsonNode *pStruct, const char *zProperty){
-  JsonStructElem *pElem;
+static JsonNode *getProperty(
+  JsonNode *pStruct,              /* Structure to search */
+  const char *zProperty,          /* Property name */
+  int nProperty                   /* Bytes in zProperty, or -1 */
+){
   JsonNode *pRes = 0;
+  int i = xjd1JsonStructFind(pStruct, zProperty, nProperty);
 
-  if( pStruct && pStruct->eJType==XJD1_STRUCT ){
-    for(pElem=pStruct->u.st.pFirst; pElem; pElem=pElem->pNext){
-      if( strcmp(pElem->zLabel, zProperty)==0 ){
-        pRes = xjd1JsonRef(pElem->pValue);
-        break;
-      }
-    }
+  if( i>=0 ){
+    pRes = xjd1JsonRef(pStruct->u.st.apValue[i]);
+  }
+  if( pRes==0 ){
+    pRes = nullJson();
   }
+  return pRes;
+}
 
+/*
+** Evaluate the x.y operator p against base object pBase.
+**
+** This is the same as getProperty(pBase, y, -1), except that the slot
+** in which label y was found is remembered on p along with the shape it
+** was found in.  When the next document has the same shape, as is
+** usual for the rows of a collection, the lookup is a single integer
+** comparison followed by an indexed load.
+*/
+static JsonNode *getPropertyCached(JsonNode *pBase, Expr *p){
+  JsonNode *pRes = 0;
+  if( pBase && pBase->eJType==XJD1_STRUCT && pBase->u.st.pShape ){
+    JsonShape *pShape = pBase->u.st.pShape;
+    int iSlot;
+    if( pShape->iShapeId==p->u.lvalue.iShapeId ){
+      iSlot = p->u.lvalue.iSlot;
+    }else{
+      iSlot = xjd1JsonStructFind(pBase, p->u.lvalue.zId, -1);
+      p->u.lvalue.iShapeId = pShape->iShapeId;
+      p->u.lvalue.iSlot = iSlot;
+    }
+    if( iSlot>=0 && iSlot<pShape->nLabel ){
+      pRes = xjd1JsonRef(pBase->u.st.apValue[iSlot]);
+    }
+  }
   if( pRes==0 ){
     pRes = nullJson();
   }
@@ -352,6 +445,7 @@ static JsonNode *getProperty(JsonNode *pStruct, const char *zProperty){
 */
 static int inOperator(JsonNode *pA, JsonNode *pB){
   char *zLHS;
+  int nLHS;
   int rc = 0;
   char zBuf[100];
   if( pA==0 ) return 0;
@@ -366,27 +460,35 @@ static int inOperator(JsonNode *pA, JsonNode *pB){
     case XJD1_REAL:
       sqlite3_snprintf(sizeof(zBuf), zBuf, "%g", pA->u.r);
       zLHS = zBuf;
+      nLHS = xjd1Strlen30(zBuf);
+      break;
+    case XJD1_INT:
+      sqlite3_snprintf(sizeof(zBuf), zBuf, "%lld", pA->u.i);
+      zLHS = zBuf;
+      nLHS = xjd1Strlen30(zBuf);
       break;
     case XJD1_STRING:
-      zLHS = pA->u.z;
+      zLHS = xjd1JsonStrText(pA);
+      nLHS = xjd1JsonStrLen(pA);
+      if( pB->eJType==XJD1_ARRAY ){
+        /* strtol() below needs a zero-terminated copy */
+        if( nLHS>=(int)sizeof(zBuf) ) return 0;
+        memcpy(zBuf, zLHS, nLHS);
+        zBuf[nLHS] = 0;
+        zLHS = zBuf;
+      }
       break;
   }
   switch( pB->eJType ){
     case XJD1_ARRAY: {
       char *zTail;
       int x = strtol(zLHS, &zTail, 0);
-      if( zTail[0]!=0 ) return 0;
+      if( zTail!=&zLHS[nLHS] ) return 0;
       rc = (x>=0 && x<pB->u.ar.nElem);
       break;
     }
     case XJD1_STRUCT: {
-      JsonStructElem *p;
-      for(p=pB->u.st.pFirst; p; p=p->pNext){
-        if( strcmp(p->zLabel, zLHS)==0 ){
-          rc = 1;
-          break;
-        }
-      }
+      rc = xjd1JsonStructFind(pB, zLHS, nLHS)>=0;
       break;
     }
     default: {
@@ -420,9 +522,9 @@ static int withinOperator(JsonNode *pA, JsonNode *pB){
       break;
     }
     case XJD1_STRUCT: {
-      JsonStructElem *p;
-      for(p=pB->u.st.pFirst; p; p=p->pNext){
-        if( xjd1JsonCompare(pA, p->pValue)==0 ){
+      int i;
+      for(i=0; i<xjd1JsonStructCount(pB); i++){
+        if( xjd1JsonCompare(pA, pB->u.st.apValue[i])==0 ){
           rc = 1;
           break;
         }
@@ -464,9 +566,14 @@ JsonNode *xjd1ExprEval(Expr *p){
       return xjd1JsonRef(p->u.json.p);
     }
 
+    case TK_PARAM: {
+      pRes = p->pStmt->apParam[p->u.param.iParam];
+      return pRes ? xjd1JsonRef(pRes) : nullJson();
+    }
+
     case TK_DOT: {
       JsonNode *pBase = xjd1ExprEval(p->u.lvalue.pLeft);
-      pRes = getProperty(pBase, p->u.lvalue.zId);
+      pRes = getPropertyCached(pBase, p);
       xjd1JsonFree(pBase);
       return pRes;
     }
@@ -494,7 +601,7 @@ JsonNode *xjd1ExprEval(Expr *p){
           String idx;
           xjd1StringInit(&idx, 0, 0);
           xjd1JsonToString(pJRight, &idx);
-          pRes = getProperty(pJLeft, idx.zBuf);
+          pRes = getProperty(pJLeft, idx.zBuf, idx.nUsed);
           xjd1StringClear(&idx);
           break;
         }
@@ -514,20 +621,18 @@ JsonNode *xjd1ExprEval(Expr *p){
           if( xjd1JsonToReal(pJRight, &rRight) ) break;
           iIdx = (int)rRight;
           if( (double)iIdx==rRight && iIdx>=0 ){
-            unsigned char *z = (unsigned char*)pJLeft->u.z;
-            for(; *z && iIdx!=0; iIdx--){
+            unsigned char *z = (unsigned char*)xjd1JsonStrText(pJLeft);
+            unsigned char *zLast = &z[xjd1JsonStrLen(pJLeft)];
+            for(; z<zLast && iIdx!=0; iIdx--){
               XJD1_SKIP_UTF8(z);
             }
-            if( *z ){
-              String x;
+            if( z<zLast ){
               unsigned char *zEnd = (unsigned char*)z;
               pRes = xjd1JsonNew(0);
               if( pRes ){
                 XJD1_SKIP_UTF8(zEnd);
-                xjd1StringInit(&x, 0, 0);
-                xjd1StringAppend(&x, (char*)z, zEnd-(unsigned char*)z);
-                pRes->eJType = XJD1_STRING;
-                pRes->u.z = xjd1StringGet(&x);
+                if( zEnd>zLast ) zEnd = zLast;
+                xjd1JsonSetString(pRes, (char*)z, (int)(zEnd - z));
               }
             }
           }
@@ -546,7 +651,9 @@ JsonNode *xjd1ExprEval(Expr *p){
 
     case TK_ID: {
       if( p->u.id.pQuery ){
-        assert( p->pStmt->pCmd->eCmdType==TK_SELECT );
+        assert( p->pStmt->pCmd->eCmdType==TK_SELECT
+             || p->pStmt->pCmd->eCmdType==TK_INSERT
+        );
         return xjd1QueryDoc(p->u.id.pQuery, p->u.id.iDatasrc);
       }else{
         assert( p->pStmt->pCmd->eCmdType==TK_DELETE
@@ -607,19 +714,30 @@ JsonNode *xjd1ExprEval(Expr *p){
   switch( p->eType ){
     case TK_STRUCT: {
       int i;
-      JsonStructElem *pElem, **ppPrev;
+      char **azLabel;
       ExprList *pList = p->u.st;
-      ppPrev = &pRes->u.st.pFirst;
+      if( pList->nEItem==0 ){
+        pRes->eJType = XJD1_STRUCT;
+        break;
+      }
+      azLabel = xjd1_malloc( pList->nEItem*sizeof(char*) );
+      if( azLabel==0 ) break;
+      for(i=0; i<pList->nEItem; i++){
+        azLabel[i] = pList->apEItem[i].zAs;
+      }
+      pRes->u.st.pShape = xjd1JsonShapeNew(pList->nEItem, azLabel, 0);
+      xjd1_free(azLabel);
+      if( pRes->u.st.pShape==0 ) break;
+      pRes->u.st.apValue = xjd1_malloc( pList->nEItem*sizeof(JsonNode*) );
+      if( pRes->u.st.apValue==0 ){
+        xjd1JsonShapeUnref(pRes->u.st.pShape);
+        pRes->u.st.pShape = 0;
+        break;
+      }
       pRes->eJType = XJD1_STRUCT;
       for(i=0; i<pList->nEItem; i++){
         ExprItem *pItem = &pList->apEItem[i];
-        pElem = xjd1_malloc( sizeof(*pElem) );
-        if( pElem==0 ) break;
-        *ppPrev = pRes->u.st.pLast = pElem;
-        ppPrev = &pElem->pNext;
-        memset(pElem, 0, sizeof(*pElem));
-        pElem->zLabel = xjd1PoolDup(0, pItem->zAs, -1);
-        pElem->pValue = xjd1ExprEval(pItem->pExpr);
+        pRes->u.st.apValue[i] = xjd1ExprEval(pItem->pExpr);
       }
       break;
     }
@@ -667,8 +785,11 @@ JsonNode *xjd1ExprEval(Expr *p){
         xjd1StringInit(&x, 0, 0);
         xjd1JsonToString(pJLeft, &x);
         xjd1JsonToString(pJRight, &x);
-        pRes->eJType = XJD1_STRING;
-        pRes->u.z = xjd1StringGet(&x);
+        xjd1JsonSetStringBuf(pRes, &x);
+      }else if( isInt(pJLeft) && isInt(pJRight)
+             && intArith(TK_PLUS, pJLeft->u.i, pJRight->u.i, &pRes->u.i)==0
+      ){
+        pRes->eJType = XJD1_INT;
       }else{
         xjd1JsonToReal(pJLeft, &rLeft);
         xjd1JsonToReal(pJRight, &rRight);
@@ -685,32 +806,46 @@ JsonNode *xjd1ExprEval(Expr *p){
     case TK_SLASH:
     case TK_MINUS: {
       pJLeft = xjd1ExprEval(p->u.bi.pLeft);
-      xjd1JsonToReal(pJLeft, &rLeft);
       if( p->u.bi.pRight==0 ){
         assert( p->eType==TK_MINUS );
-        pRes->u.r = -1.0 * rLeft;
+        if( isInt(pJLeft) && pJLeft->u.i!=SMALLEST_INT64 ){
+          pRes->eJType = XJD1_INT;
+          pRes->u.i = -pJLeft->u.i;
+        }else{
+          xjd1JsonToReal(pJLeft, &rLeft);
+          pRes->eJType = XJD1_REAL;
+          pRes->u.r = -1.0 * rLeft;
+        }
       }else{
         pJRight = xjd1ExprEval(p->u.bi.pRight);
-        xjd1JsonToReal(pJRight, &rRight);
-
-        switch( p->eType ){
-          case TK_MINUS: 
-            pRes->u.r = rLeft-rRight; 
-            break;
-
-          case TK_SLASH: 
-            if( rRight!=0.0 ){
-              pRes->u.r = rLeft / rRight; 
-            }
-            break;
+        if( p->eType!=TK_SLASH && isInt(pJLeft) && isInt(pJRight)
+         && intArith(p->eType, pJLeft->u.i, pJRight->u.i, &pRes->u.i)==0
+        ){
+          /* Integer result.  Division always yields a real, as in
+          ** javascript. */
+          pRes->eJType = XJD1_INT;
+        }else{
+          xjd1JsonToReal(pJLeft, &rLeft);
+          xjd1JsonToReal(pJRight, &rRight);
+          pRes->eJType = XJD1_REAL;
+          switch( p->eType ){
+            case TK_MINUS: 
+              pRes->u.r = rLeft-rRight; 
+              break;
+
+            case TK_SLASH: 
+              if( rRight!=0.0 ){
+                pRes->u.r = rLeft / rRight; 
+              }
+              break;
 
-          case TK_STAR: 
-            pRes->u.r = rLeft * rRight; 
-            break;
+            case TK_STAR: 
+              pRes->u.r = rLeft * rRight; 
+              break;
+          }
         }
         xjd1JsonFree(pJRight);
       }
-      pRes->eJType = XJD1_REAL;
       xjd1JsonFree(pJLeft);
       break;
     }
@@ -726,63 +861,63 @@ JsonNode *xjd1ExprEval(Expr *p){
 
     /* Bitwise operators: &, |, <<, >> and ~.
     **
-    ** These follow the javascript conventions. Arguments are converted to
-    ** 64-bit real numbers, and then to 32-bit signed integers. The bitwise
-    ** operation is performed and the result converted back to a 64-bit
-    ** real number.
-    **
-    ** TBD: When XJD1 is enhance to feature an arbitrary precision integer
-    ** type, these will have to change somehow.
+    ** Arguments are converted to 64-bit signed integers, the operation
+    ** is performed, and the result is an integer.  Reals are truncated
+    ** toward zero.  Shifting by 64 or more bits shifts out every bit, and
+    ** a negative shift amount shifts in the opposite direction.
     **
     ** This block also contains the implementation of the modulo operator.
-    ** As it requires the same 32-bit integer conversions as the bitwise
-    ** operators.
+    ** As it requires the same integer conversions as the bitwise
+    ** operators.  The remainder of a division by zero is null.
     */
     case TK_REM:
     case TK_RSHIFT:
     case TK_LSHIFT:
     case TK_BITAND:
     case TK_BITOR: {
-      int iLeft;
-      int iRight;
+      i64 iLeft;
+      i64 iRight;
 
       pJLeft = xjd1ExprEval(p->u.bi.pLeft);
       pJRight = xjd1ExprEval(p->u.bi.pRight);
-      xjd1JsonToReal(pJLeft, &rLeft);
-      xjd1JsonToReal(pJRight, &rRight);
-      iLeft = rLeft;
-      iRight = rRight;
+      xjd1JsonToInt(pJLeft, &iLeft);
+      xjd1JsonToInt(pJRight, &iRight);
+      xjd1JsonFree(pJLeft);
+      xjd1JsonFree(pJRight);
 
-      pRes->eJType = XJD1_REAL;
+      pRes->eJType = XJD1_INT;
       switch( p->eType ){
         case TK_RSHIFT: 
-          if( iRight>=32 ){
-            pRes->u.r = (double)(iLeft<0 ? -1 : 0);
-          }else{
-            pRes->u.r = (double)(iLeft >> iRight);
-          }
+          pRes->u.i = shiftLeft(iLeft, iRight<-64 ? 64 : -iRight);
           break;
 
         case TK_LSHIFT:
-          if( iRight>=32 ){
-            pRes->u.r = 0;
+          pRes->u.i = shiftLeft(iLeft, iRight<-64 ? -64 : iRight);
+          break;
+
+        case TK_BITAND: pRes->u.i = iLeft & iRight; break;
+        case TK_BITOR:  pRes->u.i = iLeft | iRight; break;
+        case TK_REM: {
+          if( iRight==0 ){
+            pRes->eJType = XJD1_NULL;
+          }else if( iRight==-1 ){
+            pRes->u.i = 0;
           }else{
-            pRes->u.r = (double)(iLeft << iRight);
+            pRes->u.i = iLeft % iRight;
           }
           break;
-
-        case TK_BITAND: pRes->u.r = (double)(iLeft & iRight); break;
-        case TK_BITOR:  pRes->u.r = (double)(iLeft | iRight); break;
-        case TK_REM:    pRes->u.r = (double)(iLeft % iRight); break;
+        }
       }
       break;
     }
 
     case TK_BITNOT: {
+      i64 iLeft;
       pJLeft = xjd1ExprEval(p->u.bi.pLeft);
-      xjd1JsonToReal(pJLeft, &rLeft);
-      pRes->eJType = XJD1_REAL;
-      pRes->u.r = (double)(~((int)rLeft));
+      xjd1JsonToInt(pJLeft, &iLeft);
+      xjd1JsonFree(pJLeft);
+      pRes->eJType = XJD1_INT;
+      pRes->u.i = ~iLeft;
       break;
     }
 
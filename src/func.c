@@ -92,9 +92,9 @@ static int xCountStep(int nArg, JsonNode **apArg, void **pp, int *pbSave){
 static JsonNode *xCountFinal(void *p){
   JsonNode *pRet;
   pRet = xjd1JsonNew(0);
-  pRet->eJType = XJD1_REAL;
+  pRet->eJType = XJD1_INT;
   if( p ){
-    pRet->u.r = (double)*(int *)p;
+    pRet->u.i = *(int *)p;
     xjd1_free(p);
   }
   return pRet;
@@ -169,16 +169,31 @@ static JsonNode *xArrayFinal(void *p){
 
 /*
 ** Aggregate function sum()
+**
+** The sum is an integer for as long as every argument is an integer and
+** the total fits in 64 bits.  After that it is a real.
 */
 static int xSumStep(int nArg, JsonNode **apArg, void **pp, int *pbSave){
   JsonNode *pVal = (JsonNode *)*pp;
+  JsonNode *pArg = apArg[0];
   double rVal = 0.0;
   if( !pVal ){
     pVal = xjd1JsonNew(0);
-    pVal->eJType = XJD1_REAL;
+    pVal->eJType = XJD1_INT;
     *pp = (void *)pVal;
   }
-  if( XJD1_OK==xjd1JsonToReal(apArg[0], &rVal) ){
+  if( pVal->eJType==XJD1_INT && pArg->eJType==XJD1_INT ){
+    i64 x = pArg->u.i;
+    if( x>=0 ? pVal->u.i<=LARGEST_INT64-x : pVal->u.i>=SMALLEST_INT64-x ){
+      pVal->u.i += x;
+      return XJD1_OK;
+    }
+  }
+  if( XJD1_OK==xjd1JsonToReal(pArg, &rVal) ){
+    if( pVal->eJType==XJD1_INT ){
+      pVal->eJType = XJD1_REAL;
+      pVal->u.r = (double)pVal->u.i;
+    }
     pVal->u.r += rVal;
   }
   return XJD1_OK;
@@ -187,7 +202,7 @@ static JsonNode *xSumFinal(void *p){
   JsonNode *pVal = (JsonNode *)p;
   if( !pVal ){
     pVal = xjd1JsonNew(0);
-    pVal->eJType = XJD1_REAL;
+    pVal->eJType = XJD1_INT;
   }
   return pVal;
 }
@@ -254,7 +269,7 @@ static JsonNode *xLength(int nArg, JsonNode **apArg){
 
   pStr = apArg[0];
   if( pStr->eJType==XJD1_STRING ){
-    nRet = xjd1Strlen30(pStr->u.z);
+    nRet = xjd1JsonStrLen(pStr);
   }else{
     String str;
     xjd1StringInit(&str, 0, 0);
@@ -264,8 +279,8 @@ static JsonNode *xLength(int nArg, JsonNode **apArg){
   }
 
   pRet = xjd1JsonNew(0);
-  pRet->eJType = XJD1_REAL;
-  pRet->u.r = (double)nRet;
+  pRet->eJType = XJD1_INT;
+  pRet->u.i = nRet;
 
   return pRet;
 }
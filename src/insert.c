@@ -0,0 +1,342 @@
+/*
+** Copyright (c) 2011 D. Richard Hipp
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the Simplified BSD License (also
+** known as the "2-Clause License" or "FreeBSD License".)
+**
+** This program is distributed in the hope that it will be useful,
+** but without any warranty; without even the implied warranty of
+** merchantability or fitness for a particular purpose.
+**
+** Author contact information:
+**   drh@hwaci.com
+**   http://www.hwaci.com/drh/
+**
+*************************************************************************
+** Code to evaluate an INSERT command.
+*/
+#include "xjd1Int.h"
+
+/*
+** Slots in xjd1_stmt.apSql[] used by INSERT.
+*/
+#define INSERT_SQL_WRITE   0    /* Add one document to the collection */
+#define INSERT_SQL_MAXROWID 1   /* Find the last document before a SELECT */
+
+/*
+** Append the n bytes of JSON text at z to a collection using pIns, an
+** "INSERT INTO coll VALUES(?1)" statement.  The text is bound directly,
+** so it is neither quoted nor compiled as part of the SQL.
+**
+** Return XJD1_OK on success.  On failure, leave an error message in the
+** connection and return XJD1_ERROR.
+*/
+static int insertText(
+  xjd1 *pConn,                   /* The connection */
+  sqlite3_stmt *pIns,            /* The INSERT statement, or NULL */
+  const char *z,                 /* Text of the document */
+  int n                          /* Bytes in z */
+){
+  int rc = XJD1_OK;
+  if( pIns==0 ){
+    xjd1Error(pConn, XJD1_ERROR, "%s", sqlite3_errmsg(pConn->db));
+    return XJD1_ERROR;
+  }
+  sqlite3_bind_text(pIns, 1, z, n, SQLITE_STATIC);
+  if( sqlite3_step(pIns)!=SQLITE_DONE ){
+    sqlite3_reset(pIns);
+    xjd1Error(pConn, XJD1_ERROR, "%s", sqlite3_errmsg(pConn->db));
+    rc = XJD1_ERROR;
+  }
+  sqlite3_reset(pIns);
+  sqlite3_clear_bindings(pIns);
+  return rc;
+}
+
+/*
+** Render document pDoc and append it to a collection using pIns.
+*/
+static int insertOne(xjd1 *pConn, sqlite3_stmt *pIns, JsonNode *pDoc){
+  String json;
+  int rc;
+  xjd1StringInit(&json, 0, 0);
+  xjd1JsonRender(&json, pDoc);
+  rc = insertText(pConn, pIns, xjd1StringText(&json), xjd1StringLen(&json));
+  xjd1StringClear(&json);
+  return rc;
+}
+
+/*
+** Append document pDoc to collection zName, using the INSERT statement
+** held in slot iSql of pStmt.  See insertOne() for the return value.
+*/
+int xjd1InsertDoc(
+  xjd1_stmt *pStmt,              /* Statement doing the insert */
+  int iSql,                      /* Slot to hold the INSERT statement */
+  const char *zName,             /* Name of the collection */
+  JsonNode *pDoc                 /* Document to insert */
+){
+  sqlite3_stmt *pIns;
+  pIns = xjd1StmtSql(pStmt, iSql, "INSERT INTO \"%w\" VALUES(?1)", zName);
+  return insertOne(pStmt->pConn, pIns, pDoc);
+}
+
+/*
+** Evaluate INSERT INTO ... SELECT.  Each result is written as soon as
+** the query produces it.  Documents that the query returns unchanged
+** are copied from storage without being parsed or rendered.
+**
+** The query may read the collection being written.  So that it does not
+** see the documents it adds, every scan of that collection stops at the
+** largest rowid the collection had when the statement started.  See
+** the isTarget field of DataSrc.
+*/
+static int insertSelect(xjd1_stmt *pStmt){
+  Command *pCmd = pStmt->pCmd;
+  Query *pQuery = pCmd->u.ins.pQuery;
+  xjd1 *pConn = pStmt->pConn;
+  sqlite3_stmt *pIns;
+  sqlite3_stmt *pMax;
+  String json;
+  int isTrans;
+  int rc = XJD1_OK;
+  int rcQuery = XJD1_DONE;
+
+  isTrans = xjd1TransBegin(pConn);
+  if( isTrans==TRANS_ERROR ) return XJD1_ERROR;
+  pMax = xjd1StmtSql(pStmt, INSERT_SQL_MAXROWID,
+                     "SELECT max(rowid) FROM \"%w\"", pCmd->u.ins.zName);
+  pStmt->iMaxRowid = 0;
+  if( pMax && sqlite3_step(pMax)==SQLITE_ROW ){
+    pStmt->iMaxRowid = sqlite3_column_int64(pMax, 0);
+  }
+  if( pMax ) sqlite3_reset(pMax);
+  pIns = xjd1StmtSql(pStmt, INSERT_SQL_WRITE,
+                     "INSERT INTO \"%w\" VALUES(?1)", pCmd->u.ins.zName);
+  xjd1StringInit(&json, 0, 0);
+  while( rc==XJD1_OK && (rcQuery = xjd1QueryStep(pQuery))==XJD1_ROW ){
+    const char *zRaw;
+    int nRaw;
+    if( xjd1QueryRawDoc(pQuery, &zRaw, &nRaw) ){
+      rc = insertText(pConn, pIns, zRaw, nRaw);
+    }else{
+      JsonNode *pDoc = xjd1QueryDoc(pQuery, 0);
+      xjd1StringTruncate(&json);
+      xjd1JsonRender(&json, pDoc);
+      xjd1JsonFree(pDoc);
+      rc = insertText(pConn, pIns, xjd1StringText(&json),
+                      xjd1StringLen(&json));
+    }
+  }
+  if( rc==XJD1_OK && rcQuery!=XJD1_DONE && rcQuery!=XJD1_OK ) rc = rcQuery;
+  xjd1StringClear(&json);
+  xjd1QueryRewind(pQuery);
+  return xjd1TransEnd(pConn, isTrans, rc);
+}
+
+/*
+** Evaluate ASYNC INSERT ... VALUE or VALUES by adding the documents to
+** the queue of the connection.  See async.c.
+*/
+static int insertAsync(xjd1_stmt *pStmt){
+  Command *pCmd = pStmt->pCmd;
+  ExprList *pList = pCmd->u.ins.pList;
+  JsonNode *pNode;
+  int rc = XJD1_OK;
+  int i;
+
+  if( pList==0 ){
+    pNode = xjd1ExprEval(pCmd->u.ins.pValue);
+    if( pNode==0 ) return XJD1_OK;
+    rc = xjd1AsyncAppend(pStmt->pConn, pCmd->u.ins.zName, pNode);
+    xjd1JsonFree(pNode);
+    return rc;
+  }
+  for(i=0; rc==XJD1_OK && i<pList->nEItem; i++){
+    pNode = xjd1ExprEval(pList->apEItem[i].pExpr);
+    if( pNode==0 ) continue;
+    rc = xjd1AsyncAppend(pStmt->pConn, pCmd->u.ins.zName, pNode);
+    xjd1JsonFree(pNode);
+  }
+  return rc;
+}
+
+/*
+** Evaluate an INSERT.  All the documents of an INSERT ... VALUES or an
+** INSERT ... SELECT are inserted in a single transaction, or none of
+** them are.
+*/
+int xjd1InsertStep(xjd1_stmt *pStmt){
+  Command *pCmd = pStmt->pCmd;
+  const char *zName;
+  JsonNode *pNode;
+  int rc = XJD1_OK;
+
+  assert( pCmd!=0 );
+  assert( pCmd->eCmdType==TK_INSERT );
+  zName = pCmd->u.ins.zName;
+  if( pCmd->u.ins.pQuery ){
+    rc = insertSelect(pStmt);
+  }else if( pCmd->u.ins.isAsync ){
+    rc = insertAsync(pStmt);
+  }else if( pCmd->u.ins.pList ){
+    ExprList *pList = pCmd->u.ins.pList;
+    int isTrans = xjd1TransBegin(pStmt->pConn);
+    int i;
+    if( isTrans==TRANS_ERROR ) return XJD1_ERROR;
+    for(i=0; rc==XJD1_OK && i<pList->nEItem; i++){
+      pNode = xjd1ExprEval(pList->apEItem[i].pExpr);
+      if( pNode==0 ) continue;
+      rc = xjd1InsertDoc(pStmt, INSERT_SQL_WRITE, zName, pNode);
+      xjd1JsonFree(pNode);
+    }
+    rc = xjd1TransEnd(pStmt->pConn, isTrans, rc);
+  }else{
+    pNode = xjd1ExprEval(pCmd->u.ins.pValue);
+    if( pNode==0 ) return XJD1_DONE;
+    rc = xjd1InsertDoc(pStmt, INSERT_SQL_WRITE, zName, pNode);
+    xjd1JsonFree(pNode);
+  }
+  return rc==XJD1_OK ? XJD1_DONE : rc;
+}
+
+/*
+** State of an xjd1_load_stream() call, passed to loadOne() for each
+** document and to loadRead() for each chunk of text.
+*/
+typedef struct LoadCtx LoadCtx;
+struct LoadCtx {
+  xjd1 *pConn;                   /* Connection being loaded */
+  sqlite3_stmt *pIns;            /* INSERT statement for the collection */
+  int (*xRead)(void*,char*,int); /* Supplies the text of the documents */
+  void *pReadArg;                /* First argument to xRead() */
+  int nDoc;                      /* Documents inserted so far */
+  u8 bFail;                      /* True if an insert failed */
+  u8 bReadFail;                  /* True if xRead() failed */
+};
+
+/* Insert one document of an xjd1_load_stream() */
+static int loadOne(void *pArg, JsonNode *pDoc){
+  LoadCtx *p = (LoadCtx*)pArg;
+  int rc = insertOne(p->pConn, p->pIns, pDoc);
+  xjd1JsonFree(pDoc);
+  if( rc==XJD1_OK ){
+    p->nDoc++;
+  }else{
+    p->bFail = 1;
+  }
+  return rc;
+}
+
+/* Read the next chunk of text of an xjd1_load_stream() */
+static int loadRead(void *pArg, char *zBuf, int nBuf){
+  LoadCtx *p = (LoadCtx*)pArg;
+  int n = p->xRead(p->pReadArg, zBuf, nBuf);
+  if( n<0 ) p->bReadFail = 1;
+  return n;
+}
+
+/*
+** Load every document in the text supplied by xRead() into collection
+** zCollection.  The text is either a single JSON array, each element of
+** which is a document, or any number of JSON values separated by
+** white-space, such as the lines of a newline-delimited JSON file.
+**
+** xRead(pReadArg, zBuf, N) stores up to N bytes of the text in zBuf and
+** returns the number of bytes stored, 0 at the end of the text, or a
+** negative number on an error.  The text is read in chunks and each
+** document is inserted as soon as it has been read, so the text need
+** never be held in memory all at once.  Documents are inserted using one
+** prepared statement, in a single transaction unless a transaction is
+** already open.  Nothing is loaded if any document cannot be parsed or
+** inserted, or if xRead() fails.
+**
+** If pnDoc is not NULL, *pnDoc is set to the number of documents loaded.
+*/
+int xjd1_load_stream(
+  xjd1 *pConn,                   /* Connection to load into */
+  const char *zCollection,       /* Name of the collection */
+  int (*xRead)(void*,char*,int), /* Supplies the text of the documents */
+  void *pReadArg,                /* First argument to xRead() */
+  int *pnDoc                     /* OUT: Number of documents loaded */
+){
+  LoadCtx x;
+  char *zSql;
+  int isTrans;
+  int rc;
+
+  if( pnDoc ) *pnDoc = 0;
+  if( pConn==0 || pConn->isDying || xRead==0 ) return XJD1_MISUSE;
+  rc = xjd1AsyncFlush(pConn);
+  if( rc ) return rc;
+  memset(&x, 0, sizeof(x));
+  x.pConn = pConn;
+  x.xRead = xRead;
+  x.pReadArg = pReadArg;
+  zSql = sqlite3_mprintf("INSERT INTO \"%w\" VALUES(?1)", zCollection);
+  if( zSql==0 ) return XJD1_NOMEM;
+  sqlite3_prepare_v2(pConn->db, zSql, -1, &x.pIns, 0);
+  sqlite3_free(zSql);
+  if( x.pIns==0 ){
+    xjd1Error(pConn, XJD1_ERROR, "%s", sqlite3_errmsg(pConn->db));
+    return XJD1_ERROR;
+  }
+  isTrans = xjd1TransBegin(pConn);
+  if( isTrans==TRANS_ERROR ){
+    sqlite3_finalize(x.pIns);
+    return XJD1_ERROR;
+  }
+  rc = xjd1JsonParseEach(loadRead, &x, loadOne, &x);
+  if( rc==XJD1_NOMEM ){
+    xjd1Error(pConn, XJD1_NOMEM, 0);
+  }else if( x.bReadFail ){
+    xjd1Error(pConn, XJD1_ERROR, "read failed after %d documents", x.nDoc);
+  }else if( rc!=XJD1_OK && !x.bFail ){
+    xjd1Error(pConn, XJD1_ERROR, "malformed JSON after %d documents",
+              x.nDoc);
+  }
+  sqlite3_finalize(x.pIns);
+  rc = xjd1TransEnd(pConn, isTrans, rc);
+  if( rc==XJD1_OK && pnDoc ) *pnDoc = x.nDoc;
+  return rc;
+}
+
+/*
+** Text of an xjd1_load() call, handed to xjd1_load_stream() by loadMem().
+*/
+typedef struct LoadMem LoadMem;
+struct LoadMem {
+  const char *z;                 /* Text not yet read */
+  int n;                         /* Bytes of z */
+};
+
+/* Copy the next chunk of an xjd1_load() text into zBuf */
+static int loadMem(void *pArg, char *zBuf, int nBuf){
+  LoadMem *p = (LoadMem*)pArg;
+  if( nBuf>p->n ) nBuf = p->n;
+  memcpy(zBuf, p->z, nBuf);
+  p->z += nBuf;
+  p->n -= nBuf;
+  return nBuf;
+}
+
+/*
+** Load every document in zJson into collection zCollection.  zJson is
+** either a single JSON array or JSON values separated by white-space,
+** as for xjd1_load_stream().
+*/
+int xjd1_load(
+  xjd1 *pConn,                   /* Connection to load into */
+  const char *zCollection,       /* Name of the collection */
+  const char *zJson,             /* Documents to load */
+  int nJson,                     /* Bytes of zJson, or -1 */
+  int *pnDoc                     /* OUT: Number of documents loaded */
+){
+  LoadMem x;
+  if( pnDoc ) *pnDoc = 0;
+  if( zJson==0 ) return XJD1_MISUSE;
+  x.z = zJson;
+  x.n = nJson<0 ? xjd1Strlen30(zJson) : nJson;
+  return xjd1_load_stream(pConn, zCollection, loadMem, &x, pnDoc);
+}
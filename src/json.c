@@ -19,15 +19,373 @@
 #include "xjd1Int.h"
 #include <ctype.h>
 
+/*
+** All JsonShape objects currently in use are kept in the following
+** hash tables, so that structures with identical label sequences share
+** a single shape.
+**
+** Shapes are shared by every connection in the process.  They are spread
+** over JSON_SHAPE_NPART partitions by the hash of their labels, each with
+** its own mutex, so that threads parsing documents seldom wait for one
+** another.  A shape does not change once it is in a table, except for
+** its reference count, which is guarded by the mutex of its partition.
+*/
+#define JSON_SHAPE_NPART 16
+typedef struct ShapePart ShapePart;
+static struct ShapePart {
+  sqlite3_mutex *pMutex;    /* Guards this partition, or NULL */
+  int nShape;               /* Number of shapes in the table */
+  int nHash;                /* Number of buckets in apHash[] */
+  JsonShape **apHash;       /* Hash buckets */
+  u64 iLastId;              /* Last JsonShape.iShapeId assigned */
+} aShapePart[JSON_SHAPE_NPART];
+static int shapeIsInit = 0;
+
+/* The partition that holds shapes whose labels hash to H */
+#define shapePart(H)  (&aShapePart[((H)>>24) & (JSON_SHAPE_NPART-1)])
+
+/*
+** Helpers for scanning text eight bytes at a time.  SWAR_HASZERO(X) is
+** non-zero if any byte of X is zero.
+*/
+#define SWAR_ONES       XJD1_U64(0x01010101,0x01010101)
+#define SWAR_HIGHS      XJD1_U64(0x80808080,0x80808080)
+#define SWAR_HASZERO(X) (((X) - SWAR_ONES) & ~(X) & SWAR_HIGHS)
+
+/* SWAR_HASLESS(X,N) is non-zero if any byte of X is less than N<=128 */
+#define SWAR_HASLESS(X,N) (((X) - SWAR_ONES*(N)) & ~(X) & SWAR_HIGHS)
+
+/*
+** Shapes with more than this many labels get a hash index on their
+** labels.  Narrower shapes are searched linearly.
+*/
+#ifndef JSON_SHAPE_HASH_MIN
+# define JSON_SHAPE_HASH_MIN 16
+#endif
+
+/*
+** Compute a hash over a sequence of labels.
+*/
+static u32 shapeHash(int nLabel, char *const*azLabel, const int *anLabel){
+  u32 h = nLabel;
+  int i, j;
+  for(i=0; i<nLabel; i++){
+    const unsigned char *z = (const unsigned char*)azLabel[i];
+    for(j=0; j<anLabel[i]; j++){ h = (h<<3) ^ (h>>28) ^ z[j]; }
+    h = (h<<3) ^ (h>>28) ^ 0xff;
+  }
+  return h;
+}
+
+/*
+** Compute a hash of a single label, for use by the slot index.
+*/
+static u32 labelHash(const char *zLabel, int nLabel){
+  const unsigned char *z = (const unsigned char*)zLabel;
+  u32 h = 0;
+  int i;
+  for(i=0; i<nLabel; i++){ h = (h*33) ^ z[i]; }
+  return h;
+}
+
+/*
+** Return true if label i of shape p is the nLabel bytes at zLabel.
+*/
+#define shapeLabelIs(p,i,zLabel,nLabel) \
+  ((p)->anLabel[i]==(nLabel) && memcmp((p)->azLabel[i],(zLabel),(nLabel))==0)
+
+/*
+** Allocate the mutexes that guard the shape tables.  This is called by
+** xjd1_open(), before any shape is created on the new connection.  In a
+** single-threaded build the mutexes are NULL and do nothing.
+*/
+void xjd1JsonInit(void){
+  sqlite3_mutex *pMaster;
+  int i;
+  if( sqlite3_initialize() ) return;
+  pMaster = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_MASTER);
+  sqlite3_mutex_enter(pMaster);
+  if( !shapeIsInit ){
+    for(i=0; i<JSON_SHAPE_NPART; i++){
+      aShapePart[i].pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+    }
+    shapeIsInit = 1;
+  }
+  sqlite3_mutex_leave(pMaster);
+}
+
+/*
+** Build the label hash index for shape p.  The index uses linear probing
+** and is never more than half full.  Slots are entered in order so that
+** if a label occurs more than once, the first occurrence is found first.
+** JsonShape.hasDup is set if a label occurs more than once.
+*/
+static int shapeBuildIndex(JsonShape *p){
+  int n = 64;
+  int i;
+  while( n<p->nLabel*2 ) n *= 2;
+  p->aSlotHash = xjd1MallocZero( sizeof(int)*n );
+  if( p->aSlotHash==0 ) return XJD1_NOMEM;
+  p->nSlotHash = n;
+  for(i=0; i<p->nLabel; i++){
+    int h = labelHash(p->azLabel[i], p->anLabel[i]) & (n-1);
+    while( p->aSlotHash[h] ){
+      int j = p->aSlotHash[h] - 1;
+      if( shapeLabelIs(p, j, p->azLabel[i], p->anLabel[i]) ) p->hasDup = 1;
+      h = (h+1) & (n-1);
+    }
+    p->aSlotHash[h] = i+1;
+  }
+  return XJD1_OK;
+}
+
+/*
+** Resize the shape hash table so that it has nNew buckets.  nNew must be
+** a power of two.
+*/
+static int shapeRehash(ShapePart *pPart, int nNew){
+  JsonShape **apNew;
+  int i;
+  apNew = xjd1MallocZero( sizeof(JsonShape*)*nNew );
+  if( apNew==0 ) return XJD1_NOMEM;
+  for(i=0; i<pPart->nHash; i++){
+    JsonShape *p, *pNext;
+    for(p=pPart->apHash[i]; p; p=pNext){
+      int h = p->iHash & (nNew-1);
+      pNext = p->pHashNext;
+      p->pHashNext = apNew[h];
+      apNew[h] = p;
+    }
+  }
+  xjd1_free(pPart->apHash);
+  pPart->apHash = apNew;
+  pPart->nHash = nNew;
+  return XJD1_OK;
+}
+
+/*
+** Return a shape for the nLabel labels in azLabel[].  If a shape with
+** the same labels in the same order already exists, its reference count
+** is incremented and it is returned.  Otherwise a new shape is created
+** with a reference count of 1.  Return NULL if nLabel==0 or on OOM.
+**
+** anLabel[] holds the length in bytes of each label.  If anLabel is NULL,
+** the labels are taken to be zero-terminated.
+**
+** The labels are copied into the shape.  The caller retains ownership
+** of azLabel[] and the strings it points to.
+*/
+JsonShape *xjd1JsonShapeNew(
+  int nLabel,                     /* Number of labels */
+  char *const*azLabel,            /* The labels */
+  const int *anLabel              /* Length of each label, or NULL */
+){
+  u32 iHash;
+  ShapePart *pPart;
+  JsonShape *p = 0;
+  int i, nByte;
+  int *anFree = 0;
+  char *z;
+
+  if( nLabel<=0 ) return 0;
+  if( anLabel==0 ){
+    anLabel = anFree = xjd1_malloc( sizeof(int)*nLabel );
+    if( anFree==0 ) return 0;
+    for(i=0; i<nLabel; i++) anFree[i] = xjd1Strlen30(azLabel[i]);
+  }
+  iHash = shapeHash(nLabel, azLabel, anLabel);
+  pPart = shapePart(iHash);
+  sqlite3_mutex_enter(pPart->pMutex);
+  if( pPart->nHash ){
+    for(p=pPart->apHash[iHash & (pPart->nHash-1)]; p; p=p->pHashNext){
+      if( p->iHash!=iHash || p->nLabel!=nLabel ) continue;
+      for(i=0; i<nLabel && shapeLabelIs(p,i,azLabel[i],anLabel[i]); i++){}
+      if( i==nLabel ){
+        p->nRef++;
+        goto shape_new_done;
+      }
+    }
+  }
+  if( pPart->nShape>=pPart->nHash
+   && shapeRehash(pPart, pPart->nHash ? pPart->nHash*2 : 64)
+  ){
+    goto shape_new_done;
+  }
+
+  nByte = sizeof(*p) + (sizeof(char*)+sizeof(int))*nLabel;
+  for(i=0; i<nLabel; i++) nByte += anLabel[i] + 1;
+  p = xjd1_malloc( nByte );
+  if( p==0 ) goto shape_new_done;
+  p->nRef = 1;
+  p->nLabel = nLabel;
+  p->iShapeId = (++pPart->iLastId)*JSON_SHAPE_NPART + (pPart - aShapePart);
+  p->iHash = iHash;
+  p->nSlotHash = 0;
+  p->aSlotHash = 0;
+  p->hasDup = 0;
+  p->azLabel = (char**)&p[1];
+  p->anLabel = (int*)&p->azLabel[nLabel];
+  z = (char*)&p->anLabel[nLabel];
+  for(i=0; i<nLabel; i++){
+    p->azLabel[i] = z;
+    p->anLabel[i] = anLabel[i];
+    memcpy(z, azLabel[i], anLabel[i]);
+    z += anLabel[i];
+    *(z++) = 0;
+  }
+  /* The index is built now, because the shape may not be changed once
+  ** other threads can see it.  Without an index, on OOM, lookups fall
+  ** back to a linear search and the shape is assumed to have duplicate
+  ** labels. */
+  if( nLabel>JSON_SHAPE_HASH_MIN ){
+    if( shapeBuildIndex(p) ) p->hasDup = 1;
+  }else{
+    for(i=1; i<nLabel && !p->hasDup; i++){
+      int j;
+      for(j=0; j<i && !shapeLabelIs(p, j, p->azLabel[i], p->anLabel[i]); j++){}
+      p->hasDup = j<i;
+    }
+  }
+  p->pHashNext = pPart->apHash[iHash & (pPart->nHash-1)];
+  pPart->apHash[iHash & (pPart->nHash-1)] = p;
+  pPart->nShape++;
+
+shape_new_done:
+  sqlite3_mutex_leave(pPart->pMutex);
+  xjd1_free(anFree);
+  return p;
+}
+
+/*
+** Add a reference to a shape.
+*/
+static void shapeRef(JsonShape *p){
+  ShapePart *pPart = shapePart(p->iHash);
+  sqlite3_mutex_enter(pPart->pMutex);
+  p->nRef++;
+  sqlite3_mutex_leave(pPart->pMutex);
+}
+
+/*
+** Decrement the reference count on a shape.  Remove it from the hash
+** table and free it when the count reaches zero.
+*/
+void xjd1JsonShapeUnref(JsonShape *p){
+  ShapePart *pPart;
+  JsonShape **pp;
+  if( p==0 ) return;
+  pPart = shapePart(p->iHash);
+  sqlite3_mutex_enter(pPart->pMutex);
+  if( (--p->nRef)>0 ){
+    sqlite3_mutex_leave(pPart->pMutex);
+    return;
+  }
+  for(pp=&pPart->apHash[p->iHash & (pPart->nHash-1)]; *pp!=p;
+      pp=&(*pp)->pHashNext){}
+  *pp = p->pHashNext;
+  pPart->nShape--;
+  if( pPart->nShape==0 ){
+    xjd1_free(pPart->apHash);
+    pPart->apHash = 0;
+    pPart->nHash = 0;
+  }
+  sqlite3_mutex_leave(pPart->pMutex);
+  xjd1_free(p->aSlotHash);
+  xjd1_free(p);
+}
+
+/*
+** Return the slot of the first element of structure p with label zLabel.
+** Return -1 if there is no such element, or if p is not a structure.
+**
+** nLabel is the length of zLabel in bytes.  If it is negative, zLabel
+** is taken to be zero-terminated.
+*/
+int xjd1JsonStructFind(const JsonNode *p, const char *zLabel, int nLabel){
+  JsonShape *pShape;
+  int i;
+  if( p==0 || p->eJType!=XJD1_STRUCT ) return -1;
+  pShape = p->u.st.pShape;
+  if( pShape==0 ) return -1;
+  if( nLabel<0 ) nLabel = xjd1Strlen30(zLabel);
+  if( pShape->aSlotHash ){
+    int mask = pShape->nSlotHash-1;
+    int h = labelHash(zLabel, nLabel) & mask;
+    while( (i = pShape->aSlotHash[h])!=0 ){
+      if( shapeLabelIs(pShape, i-1, zLabel, nLabel) ) return i-1;
+      h = (h+1) & mask;
+    }
+    return -1;
+  }
+  for(i=0; i<pShape->nLabel; i++){
+    if( shapeLabelIs(pShape, i, zLabel, nLabel) ) return i;
+  }
+  return -1;
+}
+
+/*
+** Return a new JsonSrc holding a copy of the n bytes of text at z, or
+** NULL on OOM.
+*/
+static JsonSrc *jsonSrcNew(const char *z, int n){
+  JsonSrc *p = xjd1_malloc( sizeof(*p) + n + 1 );
+  if( p ){
+    p->nRef = 1;
+    p->n = n;
+    memcpy(xjd1JsonSrcText(p), z, n);
+    xjd1JsonSrcText(p)[n] = 0;
+  }
+  return p;
+}
+
+/*
+** Release a reference to a JsonSrc.
+*/
+static void jsonSrcUnref(JsonSrc *p){
+  if( p && (--p->nRef)<=0 ) xjd1_free(p);
+}
+
+/*
+** The text an unedited array or structure was parsed from.  Only nodes
+** with JsonNode.bSpan set have one.  It is stored just past the last
+** element of u.ar.apElem[] or u.st.apValue[], in JSON_SPAN_SLOTS extra
+** slots that the parser allocates, so that scalars, which are most
+** nodes, pay nothing for it.
+*/
+typedef struct JsonSpan JsonSpan;
+struct JsonSpan {
+  JsonSrc *pSrc;            /* Document text.  Holds a reference */
+  int iOfst;                /* Offset of the value text in pSrc */
+  int n;                    /* Length of the value text */
+};
+#define JSON_SPAN_SLOTS \
+    ((int)((sizeof(JsonSpan)+sizeof(JsonNode*)-1)/sizeof(JsonNode*)))
+#define jsonSpan(P) ((JsonSpan*)((P)->eJType==XJD1_ARRAY ?              \
+    &(P)->u.ar.apElem[(P)->u.ar.nElem] :                               \
+    &(P)->u.st.apValue[xjd1JsonStructCount(P)]))
+
+/*
+** Forget the source text of p.  This must be done before p itself is
+** changed in place, and before its element array is resized.  Values
+** beneath p keep their own text.
+*/
+void xjd1JsonDropSpan(JsonNode *p){
+  if( p && p->bSpan ){
+    jsonSrcUnref(jsonSpan(p)->pSrc);
+    p->bSpan = 0;
+  }
+}
 
 /*
 ** Change a JsonNode to be a NULL.  Any substructure is deleted.
 */
 void xjd1JsonToNull(JsonNode *p){
   if( p==0 ) return;
+  xjd1JsonDropSpan(p);
   switch( p->eJType ){
     case XJD1_STRING: {
-      xjd1_free(p->u.z);
+      if( p->eStr==XJD1_STR_HEAP ) xjd1_free(p->u.str.z);
+      if( p->eStr==XJD1_STR_BORROW ) jsonSrcUnref(p->u.src.pSrc);
       break;
     }
     case XJD1_ARRAY: {
@@ -39,13 +397,12 @@ void xjd1JsonToNull(JsonNode *p){
       break;
     }
     case XJD1_STRUCT: {
-      JsonStructElem *pElem, *pNext;
-      for(pElem=p->u.st.pFirst; pElem; pElem=pNext){
-        pNext = pElem->pNext;
-        xjd1_free(pElem->zLabel);
-        xjd1JsonFree(pElem->pValue);
-        xjd1_free(pElem);
+      int i;
+      for(i=0; i<xjd1JsonStructCount(p); i++){
+        xjd1JsonFree(p->u.st.apValue[i]);
       }
+      xjd1_free(p->u.st.apValue);
+      xjd1JsonShapeUnref(p->u.st.pShape);
       break;
     }
   }
@@ -68,7 +425,7 @@ void xjd1JsonFree(JsonNode *p){
 JsonNode *xjd1JsonNew(Pool *pPool){
   JsonNode *p;
   if( pPool ){
-    p = xjd1PoolMalloc(pPool, sizeof(*p));
+    p = xjd1PoolMallocZero(pPool, sizeof(*p));
     if( p ) p->nRef = 10000;
   }else{
     p = xjd1_malloc( sizeof(*p) );
@@ -80,6 +437,54 @@ JsonNode *xjd1JsonNew(Pool *pPool){
   return p;
 }
 
+/*
+** Make p a string holding a copy of the n bytes at z, or of the whole of
+** zero-terminated string z if n is negative.  Any previous value of p is
+** discarded.  Short strings are stored inside the node itself.
+**
+** Return XJD1_OK on success.  On OOM, p is left as a NULL and XJD1_NOMEM
+** is returned.
+*/
+int xjd1JsonSetString(JsonNode *p, const char *z, int n){
+  xjd1JsonToNull(p);
+  if( n<0 ) n = xjd1Strlen30(z);
+  if( n<=XJD1_SHORT_STR ){
+    memcpy(p->u.zShort, z, n);
+    p->u.zShort[n] = 0;
+    p->nShort = (u8)n;
+    p->eStr = XJD1_STR_INLINE;
+  }else{
+    p->u.str.z = xjd1PoolDup(0, z, n);
+    if( p->u.str.z==0 ) return XJD1_NOMEM;
+    p->u.str.n = n;
+    p->eStr = XJD1_STR_HEAP;
+  }
+  p->eJType = XJD1_STRING;
+  return XJD1_OK;
+}
+
+/*
+** Make p a string holding the content of pStr, which must not use a
+** memory pool.  The buffer is handed over to p if it is too long to be
+** stored inline, saving a copy.  pStr is left empty in either case.
+*/
+int xjd1JsonSetStringBuf(JsonNode *p, String *pStr){
+  int n = xjd1StringLen(pStr);
+  int rc = XJD1_OK;
+  assert( pStr->pPool==0 );
+  if( n<=XJD1_SHORT_STR ){
+    rc = xjd1JsonSetString(p, n ? xjd1StringText(pStr) : "", n);
+    xjd1StringClear(pStr);
+  }else{
+    xjd1JsonToNull(p);
+    p->u.str.n = n;
+    p->u.str.z = xjd1StringGet(pStr);
+    p->eStr = XJD1_STR_HEAP;
+    p->eJType = XJD1_STRING;
+  }
+  return rc;
+}
+
 /*
 ** Increase the reference count on a JSON object.  
 **
@@ -94,7 +499,8 @@ JsonNode *xjd1JsonRef(JsonNode *p){
 
 
 /*
-** Return a deep copy of a JSON object.
+** Return a deep copy of a JSON object.  The copy does not remember the
+** source text of p, since it is normally made in order to be edited.
 */
 JsonNode *xjd1JsonDeepCopy(JsonNode *p){
   JsonNode *pNew;
@@ -105,7 +511,14 @@ JsonNode *xjd1JsonDeepCopy(JsonNode *p){
   pNew->u = p->u;
   switch( pNew->eJType ){
     case XJD1_STRING: {
-      pNew->u.z = xjd1PoolDup(0, p->u.z, -1);
+      if( p->eStr==XJD1_STR_BORROW ){
+        /* Text of a borrowed string is never modified, so share it */
+        pNew->eStr = XJD1_STR_BORROW;
+        p->u.src.pSrc->nRef++;
+      }else{
+        pNew->eJType = XJD1_NULL;
+        xjd1JsonSetString(pNew, xjd1JsonStrText(p), xjd1JsonStrLen(p));
+      }
       break;
     }
     case XJD1_ARRAY: {
@@ -123,16 +536,17 @@ JsonNode *xjd1JsonDeepCopy(JsonNode *p){
       break;
     }
     case XJD1_STRUCT: {
-      JsonStructElem *pSrc, *pDest, **ppPrev;
-      ppPrev = &pNew->u.st.pFirst;
-      for(pSrc=p->u.st.pFirst; pSrc; pSrc=pSrc->pNext){
-        pNew->u.st.pLast = pDest = xjd1_malloc( sizeof(*pDest) );
-        if( pDest==0 ) break;
-        memset(pDest, 0, sizeof(*pDest));
-        *ppPrev = pDest;
-        ppPrev = &pDest->pNext;
-        pDest->zLabel = xjd1PoolDup(0, pSrc->zLabel, -1);
-        pDest->pValue = xjd1JsonDeepCopy(pSrc->pValue);
+      JsonNode **ap;
+      int i, n = xjd1JsonStructCount(p);
+      if( n==0 ) break;
+      pNew->u.st.apValue = ap = xjd1_malloc( sizeof(JsonNode*)*n );
+      if( ap==0 ){
+        pNew->eJType = XJD1_NULL;
+      }else{
+        shapeRef(pNew->u.st.pShape);
+        for(i=0; i<n; i++){
+          ap[i] = xjd1JsonDeepCopy(p->u.st.apValue[i]);
+        }
       }
       break;
     }
@@ -144,37 +558,87 @@ JsonNode *xjd1JsonDeepCopy(JsonNode *p){
 ** Return an editable JSON object.  A JSON object is editable if its
 ** reference count is exactly 1.  If the input JSON object has a reference
 ** count greater than 1, then make a copy and return the copy.
+**
+** Only the source text of p itself is dropped.  Code that goes on to
+** edit a value beneath p must call xjd1JsonDropSpan() on each array or
+** structure on the way down to it.
 */
 JsonNode *xjd1JsonEdit(JsonNode *p){
   if( p==0 ) return 0;
-  if( p->nRef==1 ) return p;
+  if( p->nRef==1 ){
+    xjd1JsonDropSpan(p);
+    return p;
+  }
   return xjd1JsonDeepCopy(p);
 }
 
 
-/* Render a string as a string literal.
+/*
+** Return true if any of the eight bytes at z[] must be escaped in a JSON
+** string literal: a '"', a '\\' or a control character.  The tokenizer
+** uses this too, to step over long strings a word at a time.
 */
-void renderString(String *pOut, const char *z){
-  int n, i, j, c;
-  char *zOut;
-  for(i=n=0; (c=z[i])!=0; i++, n++){
-    if( c=='"' || c=='\\' ) n++;
-  }
-  xjd1StringAppend(pOut, 0, n+3);
-  zOut = xjd1StringText(pOut);
-  if( zOut ){
-    zOut += xjd1StringLen(pOut);
-    zOut[0] = '"';
-    for(i=0, j=1; (c=z[i])!=0; i++){
-      if( c=='"' || c=='\\' ) zOut[j++] = '\\';
-      zOut[j++] = c;
+static int hasRenderSpecial(const char *z){
+  u64 x;
+  memcpy(&x, z, 8);
+  return (SWAR_HASLESS(x, 0x20)
+        | SWAR_HASZERO(x ^ (SWAR_ONES*'"'))
+        | SWAR_HASZERO(x ^ (SWAR_ONES*'\\')))!=0;
+}
+
+/* Render the nIn bytes of zIn as a string literal.  Runs of characters
+** that need no escape are copied in one piece.  Control characters,
+** including embedded NULs, are escaped so that the output is valid JSON.
+*/
+void renderString(String *pOut, const char *z, int nIn){
+  static const char zHex[] = "0123456789abcdef";
+  int i, iStart;
+  xjd1StringAppend(pOut, "\"", 1);
+  for(i=iStart=0; i<nIn; i++){
+    char zEsc[6];
+    int nEsc = 2;
+    unsigned char c;
+    while( i+8<=nIn && !hasRenderSpecial(&z[i]) ) i += 8;
+    if( i>=nIn ) break;
+    c = (unsigned char)z[i];
+    if( c>=0x20 && c!='"' && c!='\\' ) continue;
+    if( i>iStart ) xjd1StringAppend(pOut, &z[iStart], i-iStart);
+    iStart = i+1;
+    zEsc[0] = '\\';
+    switch( c ){
+      case '"':   zEsc[1] = '"';   break;
+      case '\\':  zEsc[1] = '\\';  break;
+      case '\b':  zEsc[1] = 'b';   break;
+      case '\f':  zEsc[1] = 'f';   break;
+      case '\n':  zEsc[1] = 'n';   break;
+      case '\r':  zEsc[1] = 'r';   break;
+      case '\t':  zEsc[1] = 't';   break;
+      default: {
+        memcpy(&zEsc[1], "u00", 3);
+        zEsc[4] = zHex[c>>4];
+        zEsc[5] = zHex[c&0xf];
+        nEsc = 6;
+        break;
+      }
     }
-    zOut[j++] = '"';
-    zOut[j] = 0;
-    pOut->nUsed += j;
+    xjd1StringAppend(pOut, zEsc, nEsc);
   }
+  if( nIn>iStart ) xjd1StringAppend(pOut, &z[iStart], nIn-iStart);
+  xjd1StringAppend(pOut, "\"", 1);
 }
 
+/*
+** Render a number.  This is called for every number in every document
+** rendered, so avoid the overhead of the printf machinery.
+*/
+static void renderInt(String *pOut, i64 v){
+  char zBuf[XJD1_REAL_TEXT];
+  xjd1StringAppend(pOut, zBuf, xjd1IntToText(v, zBuf));
+}
+static void renderReal(String *pOut, double r){
+  char zBuf[XJD1_REAL_TEXT];
+  xjd1StringAppend(pOut, zBuf, xjd1RealToText(r, zBuf));
+}
 
 /*
 ** Append the text for a JSON string.
@@ -182,6 +646,10 @@ void renderString(String *pOut, const char *z){
 void xjd1JsonRender(String *pOut, const JsonNode *p){
   if( p==0 ){
     xjd1StringAppend(pOut, "null", 4);
+  }else if( p->bSpan ){
+    JsonSpan *pSpan = jsonSpan(p);
+    xjd1StringAppend(pOut, xjd1JsonSrcText(pSpan->pSrc)+pSpan->iOfst,
+                     pSpan->n);
   }else{
     switch( p->eJType ){
       case XJD1_FALSE: {
@@ -197,11 +665,15 @@ void xjd1JsonRender(String *pOut, const JsonNode *p){
         break;
       }
       case XJD1_REAL: {
-        xjd1StringAppendF(pOut, "%.17g", p->u.r);
+        renderReal(pOut, p->u.r);
+        break;
+      }
+      case XJD1_INT: {
+        renderInt(pOut, p->u.i);
         break;
       }
       case XJD1_STRING: {
-        renderString(pOut, p->u.z);
+        renderString(pOut, xjd1JsonStrText(p), xjd1JsonStrLen(p));
         break;
       }
       case XJD1_ARRAY: {
@@ -218,14 +690,15 @@ void xjd1JsonRender(String *pOut, const JsonNode *p){
       }
       case XJD1_STRUCT: {
         char cSep = '{';
-        JsonStructElem *pElem;
-        if( p->u.st.pFirst==0 ) xjd1StringAppend(pOut, &cSep, 1);
-        for(pElem=p->u.st.pFirst; pElem; pElem=pElem->pNext){
+        int i, n = xjd1JsonStructCount(p);
+        if( n==0 ) xjd1StringAppend(pOut, &cSep, 1);
+        for(i=0; i<n; i++){
           xjd1StringAppend(pOut, &cSep, 1);
           cSep = ',';
-          renderString(pOut, pElem->zLabel);
+          renderString(pOut, p->u.st.pShape->azLabel[i],
+                       p->u.st.pShape->anLabel[i]);
           xjd1StringAppend(pOut, ":", 1);
-          xjd1JsonRender(pOut, pElem->pValue);
+          xjd1JsonRender(pOut, p->u.st.apValue[i]);
         }
         xjd1StringAppend(pOut, "}", 1);
         break;
@@ -255,22 +728,84 @@ int xjd1JsonToReal(const JsonNode *p, double *pRes){
       *pRes = p->u.r;
       return 0;
     }
+    case XJD1_INT: {
+      *pRes = (double)p->u.i;
+      return 0;
+    }
     case XJD1_STRING: {
+      const char *z = xjd1JsonStrText(p);
+      int n = xjd1JsonStrLen(p);
       char *zEnd;
-      if( isspace(p->u.z[0]) ){
+      char zBuf[100];
+      i64 v;
+      switch( xjd1TextToNumber(z, n, &v, pRes) ){
+        case XJD1_INT:   *pRes = (double)v;  return 0;
+        case XJD1_REAL:  return 0;
+      }
+      /* Not in JSON number syntax.  See if strtod() will accept it. */
+      if( n==0 || isspace(z[0]) ){
+        return 1;
+      }
+      if( z[n]!=0 ){
+        /* strtod() needs a terminator.  No number is this long. */
+        if( n>=(int)sizeof(zBuf) ) return 1;
+        memcpy(zBuf, z, n);
+        zBuf[n] = 0;
+        z = zBuf;
+      }
+      *pRes = strtod(z, &zEnd);
+      if( zEnd!=&z[n] ){
         return 1;
-      }else{
-        *pRes = strtod(p->u.z, &zEnd);
-        if( zEnd[0]!=0 ){
-          return 1;
-        }
-        return 0;
       }
+      return 0;
     }
   }
   return 1;
 }
 
+/*
+** Set JSON object p to the number whose text is the n bytes of z.  The
+** value is an XJD1_INT if the text is an integer that fits in 64 bits
+** and an XJD1_REAL otherwise.  If the text is not a number, p is null.
+*/
+void xjd1JsonSetNumber(JsonNode *p, const char *z, int n){
+  xjd1JsonToNull(p);
+  switch( xjd1TextToNumber(z, n, &p->u.i, &p->u.r) ){
+    case XJD1_INT:  p->eJType = XJD1_INT;   break;
+    case XJD1_REAL: p->eJType = XJD1_REAL;  break;
+  }
+}
+
+/*
+** Attempt to convert a JSON object into a 64-bit integer.  Reals are
+** truncated toward zero and clamped to the range of an integer.  Return
+** 0 if successful and 1 if there is an error.
+*/
+int xjd1JsonToInt(const JsonNode *p, i64 *pRes){
+  double r;
+  *pRes = 0;
+  if( p==0 ) return 1;
+  if( p->eJType==XJD1_INT ){
+    *pRes = p->u.i;
+    return 0;
+  }
+  if( p->eJType==XJD1_STRING
+   && xjd1TextToNumber(xjd1JsonStrText(p), xjd1JsonStrLen(p), pRes, &r)
+        ==XJD1_INT
+  ){
+    return 0;
+  }
+  if( xjd1JsonToReal(p, &r) ) return 1;
+  if( r>=9223372036854775807.0 ){
+    *pRes = LARGEST_INT64;
+  }else if( r<=-9223372036854775808.0 ){
+    *pRes = SMALLEST_INT64;
+  }else if( r==r ){
+    *pRes = (i64)r;
+  }
+  return 0;
+}
+
 /*
 ** Attempt to convert a JSON object into a string.  Return 0
 ** if successful and 1 if there is an error.
@@ -290,7 +825,11 @@ int xjd1JsonToString(const JsonNode *p, String *pOut){
       break;
     }
     case XJD1_REAL: {
-      xjd1StringAppendF(pOut, "%.17g", p->u.r);
+      renderReal(pOut, p->u.r);
+      break;
+    }
+    case XJD1_INT: {
+      renderInt(pOut, p->u.i);
       break;
     }
     case XJD1_NULL: {
@@ -298,7 +837,7 @@ int xjd1JsonToString(const JsonNode *p, String *pOut){
       break;
     }
     case XJD1_STRING: {
-      xjd1StringAppend(pOut, p->u.z, -1);
+      xjd1StringAppend(pOut, xjd1JsonStrText(p), xjd1JsonStrLen(p));
       break;
     }
     case XJD1_ARRAY: {
@@ -313,6 +852,37 @@ int xjd1JsonToString(const JsonNode *p, String *pOut){
   return 0;
 }
 
+/*
+** Compare two byte strings that may contain embedded NULs.
+*/
+static int compareBytes(const char *zA, int nA, const char *zB, int nB){
+  int c = memcmp(zA, zB, nA<nB ? nA : nB);
+  return c ? c : nA - nB;
+}
+
+/*
+** Compare integer i against real r exactly, without rounding i to a
+** double.
+*/
+static int compareIntReal(i64 i, double r){
+  i64 y;
+  if( r!=r ) return 0;
+  if( r<-9223372036854775808.0 ) return 1;
+  if( r>=9223372036854775808.0 ) return -1;
+  y = (i64)r;
+  if( i<y ) return -1;
+  if( i>y ) return 1;
+  if( r>(double)y ) return -1;
+  if( r<(double)y ) return 1;
+  return 0;
+}
+
+/*
+** The sort order of a JSON type.  Integers and reals are both numbers
+** and compare by value.
+*/
+#define jsonTypeRank(X) ((X)==XJD1_INT ? XJD1_REAL : (X))
+
 /*
 ** Compare to JSON objects.  Return negative, zero, or positive if the
 ** first is less than, equal to, or greater than the second.
@@ -325,9 +895,19 @@ int xjd1JsonCompare(const JsonNode *pLeft, const JsonNode *pRight){
     return 1;
   }
   if( pLeft->eJType!=pRight->eJType ){
-    return pLeft->eJType - pRight->eJType;
+    int eL = jsonTypeRank(pLeft->eJType);
+    int eR = jsonTypeRank(pRight->eJType);
+    if( eL!=eR ) return eL - eR;
+    if( pLeft->eJType==XJD1_INT ){
+      return compareIntReal(pLeft->u.i, pRight->u.r);
+    }
+    return -compareIntReal(pRight->u.i, pLeft->u.r);
   }
   switch( pLeft->eJType ){
+    case XJD1_INT: {
+      if( pLeft->u.i<pRight->u.i ) return -1;
+      return pLeft->u.i>pRight->u.i;
+    }
     case XJD1_REAL: {
       if( pLeft->u.r<pRight->u.r ){
         return -1;
@@ -338,7 +918,8 @@ int xjd1JsonCompare(const JsonNode *pLeft, const JsonNode *pRight){
       return 0;
     }
     case XJD1_STRING: {
-      return strcmp(pLeft->u.z, pRight->u.z);
+      return compareBytes(xjd1JsonStrText(pLeft), xjd1JsonStrLen(pLeft),
+                          xjd1JsonStrText(pRight), xjd1JsonStrLen(pRight));
     }
     case XJD1_ARRAY: {
       int i, mx, c;
@@ -351,21 +932,24 @@ int xjd1JsonCompare(const JsonNode *pLeft, const JsonNode *pRight){
       return pLeft->u.ar.nElem - pRight->u.ar.nElem;
     }
     case XJD1_STRUCT: {
-      JsonStructElem *pA = pLeft->u.st.pFirst;
-      JsonStructElem *pB = pRight->u.st.pFirst;
-      int c = 0;
-      while( pA && pB ){
-        c = strcmp(pA->zLabel, pB->zLabel);
-        if( c ) return c;
-        c = xjd1JsonCompare(pA->pValue, pB->pValue);
+      JsonShape *pA = pLeft->u.st.pShape;
+      JsonShape *pB = pRight->u.st.pShape;
+      int nA = xjd1JsonStructCount(pLeft);
+      int nB = xjd1JsonStructCount(pRight);
+      int i, c;
+      for(i=0; i<nA && i<nB; i++){
+        if( pA!=pB ){
+          c = compareBytes(pA->azLabel[i], pA->anLabel[i],
+                           pB->azLabel[i], pB->anLabel[i]);
+          if( c ) return c;
+        }
+        c = xjd1JsonCompare(pLeft->u.st.apValue[i], pRight->u.st.apValue[i]);
         if( c ) return c;
-        pA = pA->pNext;
-        pB = pB->pNext;
       }
-      if( pA ){
+      if( nA>nB ){
         return 1;
       }
-      if( pB ){
+      if( nA<nB ){
         return -1;
       }
       return 0;
@@ -399,6 +983,13 @@ struct JsonStr {
   int iCur;               /* First character of current token */
   int n;                  /* Number of charaters in current token */
   int eType;              /* Type of current token */
+  int bEscape;            /* True if current JSON_STRING contains a '\\' */
+  int iEnd;               /* End of the token before the current one */
+  int nSpace;             /* Runs of white-space skipped so far */
+  int bSpace;             /* True if white-space precedes the current token */
+  int nDirty;             /* Values seen that do not render as their text */
+  int bDirty;             /* True if the current token counts in nDirty */
+  JsonSrc *pSrc;          /* Copy of zIn, or NULL after OOM */
 };
 
 /* Return the type of the current token */
@@ -420,6 +1011,36 @@ static int isExp(const char *z, int n){
   return 0;
 }
 
+/*
+** The n bytes at z[] begin with a '\\' inside a string token.  Return
+** true if the escape is the one renderString() would write for the
+** character it stands for.
+*/
+static int isRenderEscape(const char *z, int n){
+  int c;
+  if( n<2 ) return 0;
+  switch( z[1] ){
+    case '"': case '\\': case 'b': case 'f': case 'n': case 'r': case 't': {
+      return 1;
+    }
+    case 'u': {
+      if( n<6 || z[2]!='0' || z[3]!='0' || (z[4]!='0' && z[4]!='1') ){
+        return 0;
+      }
+      if( xjd1Isdigit(z[5]) ){
+        c = z[5] - '0';
+      }else if( z[5]>='a' && z[5]<='f' ){
+        c = z[5] - 'a' + 10;
+      }else{
+        return 0;
+      }
+      c += (z[4] - '0')*16;
+      return c!='\b' && c!='\f' && c!='\n' && c!='\r' && c!='\t';
+    }
+  }
+  return 0;
+}
+
 /* Advance to the next token */
 static void tokenNext(JsonStr *p){
   int i, n;
@@ -427,8 +1048,11 @@ static void tokenNext(JsonStr *p){
   int mx = p->mxIn;
   char c;
 
-  i = p->n + p->iCur;
+  i = p->iEnd = p->n + p->iCur;
   while( i<mx && xjd1Isspace(z[i]) ){ i++; }
+  p->bSpace = i>p->iEnd;
+  p->nSpace += p->bSpace;
+  p->bDirty = 0;
   if( i>=mx ) goto token_eof;
   p->iCur = i;
   switch( i<mx ? z[i] : 0 ){
@@ -436,13 +1060,26 @@ static void tokenNext(JsonStr *p){
       goto token_eof;
     }
     case '"': {
-     for(n=1; i+n<mx && (c = z[i+n])!=0 && c!='"'; n++){
-        if( c=='\\' ) n++;
+      p->bEscape = 0;
+      c = 0;
+      for(n=1; i+n<mx; n++){
+        while( i+n+8<=mx && !hasRenderSpecial(&z[i+n]) ) n += 8;
+        if( i+n>=mx ){ c = 0; break; }
+        c = z[i+n];
+        if( c==0 || c=='"' ) break;
+        if( c=='\\' ){
+          if( !isRenderEscape(&z[i+n], mx-(i+n)) ) p->bDirty = 1;
+          n++;
+          p->bEscape = 1;
+        }else if( (unsigned char)c<0x20 ){
+          p->bDirty = 1;
+        }
       }
       if( c=='"' ) n++;
       if( i+n>mx ){ n = mx - i; c = 0; }
       p->n = n;
       p->eType = (c=='"' ? JSON_STRING : JSON_ERROR);
+      p->nDirty += p->bDirty;
       break;
     }
     case '{': {
@@ -555,9 +1192,57 @@ token_eof:
 }
 
 /*
-** Dequote a string in-place.
+** Read four hexadecimal digits from z[].  Return the value, or -1 if any
+** of the four characters is not a hex digit.
+*/
+static int readHex4(const char *z){
+  int i, v = 0;
+  for(i=0; i<4; i++){
+    char c = z[i];
+    if( !xjd1Isxdigit(c) ) return -1;
+    v = v*16 + (c<='9' ? c-'0' : (c|0x20)-'a'+10);
+  }
+  return v;
+}
+
+/*
+** Write code point c into z[] as UTF-8.  Return the number of bytes
+** written.  At most 4 bytes are written.
 */
-void xjd1DequoteString(char *z, int n){
+static int writeUtf8(char *z, unsigned int c){
+  if( c<0x80 ){
+    z[0] = (char)c;
+    return 1;
+  }
+  if( c<0x800 ){
+    z[0] = (char)(0xc0 | (c>>6));
+    z[1] = (char)(0x80 | (c&0x3f));
+    return 2;
+  }
+  if( c<0x10000 ){
+    z[0] = (char)(0xe0 | (c>>12));
+    z[1] = (char)(0x80 | ((c>>6)&0x3f));
+    z[2] = (char)(0x80 | (c&0x3f));
+    return 3;
+  }
+  z[0] = (char)(0xf0 | (c>>18));
+  z[1] = (char)(0x80 | ((c>>12)&0x3f));
+  z[2] = (char)(0x80 | ((c>>6)&0x3f));
+  z[3] = (char)(0x80 | (c&0x3f));
+  return 4;
+}
+
+/*
+** Dequote a string in-place.  Return the number of bytes in the
+** dequoted string, not counting the zero terminator.  The result may
+** contain embedded NULs if the input contains \u0000.
+**
+** A \uXXXX escape is converted to UTF-8.  A UTF-16 surrogate pair
+** written as two consecutive escapes becomes a single code point.  The
+** UTF-8 form is never longer than the escape it replaces, so the
+** conversion can be done in place.
+*/
+int xjd1DequoteString(char *z, int n){
   int i, j;
   char c;
   assert( n>=2 );
@@ -578,77 +1263,181 @@ void xjd1DequoteString(char *z, int n){
         z[j++] = '\r';
       }else if( c=='t' ){
         z[j++] = '\t';
-      }else if( c=='u' && i<n-4 ){
-        /* FIX ME */
+      }else if( c=='u' && i+4<n-1 && readHex4(&z[i+1])>=0 ){
+        unsigned int v = readHex4(&z[i+1]);
+        i += 4;
+        if( v>=0xd800 && v<0xdc00 && i+6<n-1 && z[i+1]=='\\' && z[i+2]=='u' ){
+          int lo = readHex4(&z[i+3]);
+          if( lo>=0xdc00 && lo<0xe000 ){
+            v = 0x10000 + ((v-0xd800)<<10) + (lo-0xdc00);
+            i += 6;
+          }
+        }
+        j += writeUtf8(&z[j], v);
       }else{
         z[j++] = c;
       }
     }
   }
   z[j] = 0;
+  return j;
 }
 
 /* Convert the current token (which must be a string) into a true
 ** string (resolving all of the backslash escapes) and return a pointer
-** to the true string.  Space is obtained from xjd1_malloc().
+** to the true string.  Space is obtained from xjd1_malloc().  The length
+** of the string in bytes is written to *pnOut.
 */
-static char *tokenDequoteString(JsonStr *pIn){
+static char *tokenDequoteString(JsonStr *pIn, int *pnOut){
   const char *zIn;
   char *zOut;
-  int n;
   zIn = &pIn->zIn[pIn->iCur];
   zOut = xjd1_malloc( pIn->n );
+  *pnOut = 0;
   if( zOut==0 ) return 0;
   assert( zIn[0]=='"' && zIn[pIn->n-1]=='"' );
-  n = pIn->n-1;
   memcpy(zOut, zIn, pIn->n);
-  xjd1DequoteString(zOut, pIn->n);
+  *pnOut = xjd1DequoteString(zOut, pIn->n);
   return zOut;
 }
 
 
+static JsonNode *parseJson(JsonStr*);
+
+/*
+** Return true if number p, parsed from the n bytes of text at z, is
+** rendered as exactly that text.  A number too large for a double is
+** rendered as null, so it never is.
+*/
+static int jsonNumberIsCanonical(const JsonNode *p, const char *z, int n){
+  char zBuf[XJD1_REAL_TEXT];
+  int m;
+  if( p->eJType==XJD1_INT ){
+    m = xjd1IntToText(p->u.i, zBuf);
+  }else{
+    m = xjd1RealToText(p->u.r, zBuf);
+  }
+  return m==n && memcmp(zBuf, z, n)==0;
+}
+
 /* Enter point to the first token of the JSON object.
 ** Exit pointing to the first token past end end of the
 ** JSON object.
 */
-static JsonNode *parseJson(JsonStr *pIn){
+static JsonNode *parseJsonValue(JsonStr *pIn){
   JsonNode *pNew;
   pNew = xjd1JsonNew(0);
   if( pNew==0 ) return 0;
   pNew->eJType = tokenType(pIn);
   switch( pNew->eJType ){
     case JSON_BEGIN_STRUCT: {
-      JsonStructElem **ppTail;
+      int nAlloc = 0;              /* Slots allocated in anLabel and apValue */
+      int nElem = 0;               /* Slots used */
+      String sLabel;               /* Text of labels that contain escapes */
+      int *anLabel = 0;            /* Length of each label */
+      int *aiLabel = 0;            /* Where each label is.  See below */
+      JsonNode **apValue = 0;      /* Values seen so far */
+      char *azStatic[16];          /* Space for azLabel for small structs */
+      char **azLabel;              /* Pointer to each label in sLabel */
+      int rc = XJD1_OK;
+      int i, iOfst;
+
+      pNew->u.st.pShape = 0;
+      pNew->u.st.apValue = 0;
       tokenNext(pIn);
-      if( tokenType(pIn)==JSON_END_STRUCT ) break;
-      ppTail = &pNew->u.st.pFirst;
+      if( tokenType(pIn)==JSON_END_STRUCT ){
+        tokenNext(pIn);
+        break;
+      }
+      xjd1StringInit(&sLabel, 0, 0);
       while( 1 ){
-        JsonStructElem *pElem;
         if( tokenType(pIn)!=JSON_STRING ){
-          goto json_error; 
+          rc = XJD1_ERROR;
+          break;
+        }
+        if( nElem>=nAlloc ){
+          int *anNew, *aiNew;
+          JsonNode **apNew;
+          nAlloc = nAlloc*2 + 5;
+          anNew = xjd1_realloc(anLabel, sizeof(int)*nAlloc);
+          if( anNew ) anLabel = anNew;
+          aiNew = xjd1_realloc(aiLabel, sizeof(int)*nAlloc);
+          if( aiNew ) aiLabel = aiNew;
+          apNew = xjd1_realloc(apValue,
+                               sizeof(JsonNode*)*(nAlloc+JSON_SPAN_SLOTS));
+          if( apNew ) apValue = apNew;
+          if( anNew==0 || aiNew==0 || apNew==0 ){
+            rc = XJD1_NOMEM;
+            break;
+          }
         }
-        pElem = xjd1_malloc( sizeof(*pElem) );
-        if( pElem==0 ) goto json_error;
-        memset(pElem, 0, sizeof(*pElem));
-        *ppTail = pElem;
-        pNew->u.st.pLast = pElem;
-        ppTail = &pElem->pNext;
-        pElem->zLabel = tokenDequoteString(pIn);
+
+        /* A label without escapes is used directly from the input text,
+        ** and aiLabel[] holds its offset within zIn.  Other labels are
+        ** appended to sLabel and dequoted there.  For these, aiLabel[]
+        ** holds -1 minus the offset within sLabel. */
+        if( !pIn->bEscape ){
+          aiLabel[nElem] = pIn->iCur+1;
+          anLabel[nElem] = pIn->n-2;
+        }else{
+          iOfst = xjd1StringLen(&sLabel);
+          if( xjd1StringAppend(&sLabel, tokenString(pIn), pIn->n)<pIn->n ){
+            rc = XJD1_NOMEM;
+            break;
+          }
+          anLabel[nElem] = xjd1DequoteString(&sLabel.zBuf[iOfst], pIn->n);
+          aiLabel[nElem] = -1 - iOfst;
+          sLabel.nUsed = iOfst + anLabel[nElem];
+        }
+        apValue[nElem] = 0;
+        nElem++;
+
         tokenNext(pIn);
         if( tokenType(pIn)!=JSON_COLON ){
-          goto json_error;
+          rc = XJD1_ERROR;
+          break;
         }
         tokenNext(pIn);
-        pElem->pValue = parseJson(pIn);
+        apValue[nElem-1] = parseJson(pIn);
         if( tokenType(pIn)==JSON_COMMA ){
           tokenNext(pIn);
         }else if( tokenType(pIn)==JSON_END_STRUCT ){
           tokenNext(pIn);
           break;
         }else{
-          goto json_error;
+          rc = XJD1_ERROR;
+          break;
+        }
+      }
+      if( rc==XJD1_OK ){
+        if( nElem<=ArraySize(azStatic) ){
+          azLabel = azStatic;
+        }else{
+          azLabel = xjd1_malloc( sizeof(char*)*nElem );
+        }
+        if( azLabel ){
+          for(i=0; i<nElem; i++){
+            if( aiLabel[i]>=0 ){
+              azLabel[i] = (char*)&pIn->zIn[aiLabel[i]];
+            }else{
+              azLabel[i] = &sLabel.zBuf[-1 - aiLabel[i]];
+            }
+          }
+          pNew->u.st.pShape = xjd1JsonShapeNew(nElem, azLabel, anLabel);
+          if( azLabel!=azStatic ) xjd1_free(azLabel);
         }
+        if( pNew->u.st.pShape==0 ) rc = XJD1_NOMEM;
+      }
+      xjd1StringClear(&sLabel);
+      xjd1_free(anLabel);
+      xjd1_free(aiLabel);
+      if( rc!=XJD1_OK ){
+        for(i=0; i<nElem; i++) xjd1JsonFree(apValue[i]);
+        xjd1_free(apValue);
+        goto json_error;
       }
+      pNew->u.st.apValue = apValue;
+      if( pNew->u.st.pShape->hasDup ) pIn->nDirty++;
       break;
     }
     case JSON_BEGIN_ARRAY: {
@@ -663,7 +1452,7 @@ static JsonNode *parseJson(JsonStr *pIn){
           JsonNode **pNewArray;
           nAlloc = nAlloc*2 + 5;
           pNewArray = xjd1_realloc(pNew->u.ar.apElem,
-                              sizeof(JsonNode*)*nAlloc);
+                              sizeof(JsonNode*)*(nAlloc+JSON_SPAN_SLOTS));
           if( pNewArray==0 ) goto json_error;
           pNew->u.ar.apElem = pNewArray;
         }
@@ -680,12 +1469,42 @@ static JsonNode *parseJson(JsonStr *pIn){
       break;
     }
     case JSON_STRING: {
-      pNew->u.z = tokenDequoteString(pIn);
+      if( pIn->n<=XJD1_SHORT_STR+2 ){
+        /* Short enough to be stored inline.  Avoid the malloc(). */
+        if( pIn->bEscape ){
+          char zBuf[XJD1_SHORT_STR+3];
+          memcpy(zBuf, tokenString(pIn), pIn->n);
+          pNew->nShort = (u8)xjd1DequoteString(zBuf, pIn->n);
+          memcpy(pNew->u.zShort, zBuf, pNew->nShort+1);
+        }else{
+          pNew->nShort = (u8)(pIn->n-2);
+          memcpy(pNew->u.zShort, tokenString(pIn)+1, pNew->nShort);
+          pNew->u.zShort[pNew->nShort] = 0;
+        }
+        pNew->eStr = XJD1_STR_INLINE;
+      }else if( !pIn->bEscape ){
+        /* No escapes.  Refer to the string within the copy of the input
+        ** text. */
+        if( pIn->pSrc==0 ) goto json_error;
+        pIn->pSrc->nRef++;
+        pNew->u.src.pSrc = pIn->pSrc;
+        pNew->u.src.iOfst = pIn->iCur+1;
+        pNew->u.src.n = pIn->n-2;
+        pNew->eStr = XJD1_STR_BORROW;
+      }else{
+        pNew->u.str.z = tokenDequoteString(pIn, &pNew->u.str.n);
+        if( pNew->u.str.z==0 ) goto json_error;
+        pNew->eStr = XJD1_STR_HEAP;
+      }
+      pNew->eJType = XJD1_STRING;
       tokenNext(pIn);
       break;
     }
     case JSON_REAL: {
-      pNew->u.r = atof(tokenString(pIn));
+      xjd1JsonSetNumber(pNew, tokenString(pIn), pIn->n);
+      if( !jsonNumberIsCanonical(pNew, tokenString(pIn), pIn->n) ){
+        pIn->nDirty++;
+      }
       tokenNext(pIn);
       break;
     }
@@ -708,18 +1527,276 @@ json_error:
   return 0;
 }
 
+/*
+** Parse a single JSON value.  If the value is a non-empty array or
+** structure and its text contains no white-space, remember where that
+** text is so that xjd1JsonRender() can copy it rather than reconstructing
+** it.
+**
+** The text is not remembered if rendering the value would give different
+** text:  if a string in it has an escape that xjd1JsonRender() would
+** write differently or a raw control character, if a structure in it has
+** a label more than once, or if a number in it is not written the way
+** xjd1JsonRender() writes it.
+*/
+static JsonNode *parseJson(JsonStr *pIn){
+  int iStart = pIn->iCur;          /* Offset of the first token */
+  int nSpace = pIn->nSpace;        /* White-space runs before the value */
+  int nDirty = pIn->nDirty;        /* Values not rendered as their text */
+  JsonNode *pNew;
+
+  pNew = parseJsonValue(pIn);
+  if( pNew && pIn->pSrc
+   && ((pNew->eJType==XJD1_ARRAY && pNew->u.ar.nElem>0)
+       || (pNew->eJType==XJD1_STRUCT && xjd1JsonStructCount(pNew)>0))
+   && pIn->nSpace-pIn->bSpace==nSpace
+   && pIn->nDirty-pIn->bDirty==nDirty
+  ){
+    JsonSpan *pSpan = jsonSpan(pNew);
+    pIn->pSrc->nRef++;
+    pSpan->pSrc = pIn->pSrc;
+    pSpan->iOfst = iStart;
+    pSpan->n = pIn->iEnd - iStart;
+    pNew->bSpan = 1;
+  }
+  return pNew;
+}
+
 /*
 ** Parse up a JSON string
 */
+static void jsonStrInit(JsonStr *p, const char *zIn, int mxIn){
+  p->zIn = zIn;
+  p->mxIn = mxIn>0 ? mxIn : xjd1Strlen30(zIn);
+  p->iCur = 0;
+  p->n = 0;
+  p->eType = 0;
+  p->bEscape = 0;
+  p->iEnd = 0;
+  p->nSpace = 0;
+  p->bSpace = 0;
+  p->nDirty = 0;
+  p->bDirty = 0;
+  p->pSrc = jsonSrcNew(p->zIn, p->mxIn);
+  tokenNext(p);
+}
 JsonNode *xjd1JsonParse(const char *zIn, int mxIn){
+  JsonNode *pRet;
   JsonStr x;
-  x.zIn = zIn;
-  x.mxIn = mxIn>0 ? mxIn : xjd1Strlen30(zIn);
-  x.iCur = 0;
-  x.n = 0;
-  x.eType = 0;
-  tokenNext(&x);
-  return parseJson(&x);
+  jsonStrInit(&x, zIn, mxIn);
+  pRet = parseJson(&x);
+  jsonSrcUnref(x.pSrc);
+  return pRet;
+}
+
+/*
+** Parse zIn, which must hold exactly one JSON value, possibly with
+** white-space around it.  Return NULL if it does not.
+*/
+static JsonNode *jsonParseOne(const char *zIn, int mxIn){
+  JsonNode *pRet;
+  JsonStr x;
+  jsonStrInit(&x, zIn, mxIn);
+  pRet = parseJson(&x);
+  if( pRet && tokenType(&x)!=JSON_EOF ){
+    xjd1JsonFree(pRet);
+    pRet = 0;
+  }
+  jsonSrcUnref(x.pSrc);
+  return pRet;
+}
+
+/*
+** Bytes of text read at a time by xjd1JsonParseEach().
+*/
+#define JSON_READ_CHUNK  16384
+
+/*
+** Shapes of the text read by xjd1JsonParseEach().
+*/
+#define JSON_EACH_UNKNOWN   0    /* No value seen yet */
+#define JSON_EACH_SEQUENCE  1    /* Values separated by white-space */
+#define JSON_EACH_ARRAY     2    /* Inside an array of values */
+#define JSON_EACH_DONE      3    /* After the "]" of the array */
+
+/*
+** Read JSON text with xRead() and hand each value in it to xValue(),
+** which takes ownership of the value.  The text is either any number of
+** values separated by white-space, such as newline-delimited JSON, or a
+** single array, in which case its elements are handed over one by one.
+** Text that starts with "[" is taken to be an array.
+**
+** xRead(pReadArg, zBuf, N) stores up to N bytes of text in zBuf and
+** returns the number of bytes stored, 0 at the end of the text, or a
+** negative number on an error.
+**
+** The end of each value is found by a scan of its brackets and strings,
+** and only then is the value parsed.  Text before the value being
+** scanned is discarded, so the memory used depends on the size of the
+** largest value and not on the size of the text.
+**
+** Stop and return the result of xValue() if it is not XJD1_OK.  Return
+** XJD1_NOMEM if out of memory and XJD1_ERROR if xRead() fails or the
+** text is not well-formed.  Otherwise return XJD1_OK.
+*/
+int xjd1JsonParseEach(
+  int (*xRead)(void*,char*,int),        /* Supplies the text */
+  void *pReadArg,                       /* First argument to xRead() */
+  int (*xValue)(void*,JsonNode*),       /* Receives each value */
+  void *pArg                            /* First argument to xValue() */
+){
+  char *zBuf = 0;         /* Text not yet scanned or in the current value */
+  int nAlloc = 0;         /* Bytes allocated for zBuf */
+  int nBuf = 0;           /* Bytes of text in zBuf */
+  int i = 0;              /* Next byte of zBuf to scan */
+  int iStart = -1;        /* Offset of the current value, or -1 if none */
+  int nDepth = 0;         /* Brackets open in the current value */
+  int inStr = 0;          /* True if inside a string */
+  int eMode = JSON_EACH_UNKNOWN;   /* Shape of the text */
+  int bElem = 0;          /* True if an array element was the last thing */
+  int bComma = 0;         /* True if a "," was the last thing */
+  int bEof = 0;           /* True if xRead() has reached the end */
+  int rc = XJD1_OK;
+
+  while( rc==XJD1_OK ){
+    int iEnd = -1;        /* End of the current value, if found */
+    char c;
+
+    if( i>=nBuf ){
+      if( !bEof ){
+        /* Keep only the current value, then read more text */
+        int n;
+        if( iStart<0 ){
+          i -= nBuf;
+          nBuf = 0;
+        }else if( iStart>0 ){
+          memmove(zBuf, &zBuf[iStart], nBuf-iStart);
+          nBuf -= iStart;
+          i -= iStart;
+          iStart = 0;
+        }
+        if( nAlloc-nBuf<JSON_READ_CHUNK ){
+          int nNew = nAlloc*2;
+          char *zNew;
+          if( nNew<nBuf+JSON_READ_CHUNK ) nNew = nBuf+JSON_READ_CHUNK;
+          zNew = xjd1_realloc(zBuf, nNew);
+          if( zNew==0 ){
+            rc = XJD1_NOMEM;
+            break;
+          }
+          zBuf = zNew;
+          nAlloc = nNew;
+        }
+        n = xRead(pReadArg, &zBuf[nBuf], JSON_READ_CHUNK);
+        if( n<0 ) rc = XJD1_ERROR;
+        if( n<=0 ) bEof = 1;
+        if( n>0 ) nBuf += n;
+        continue;
+      }
+
+      /* End of the text.  A value that runs to the end must be complete,
+      ** and an array must have been closed. */
+      if( eMode==JSON_EACH_ARRAY ){
+        rc = XJD1_ERROR;
+      }else if( iStart>=0 && !inStr && nDepth==0 ){
+        JsonNode *pValue = jsonParseOne(&zBuf[iStart], nBuf-iStart);
+        rc = pValue ? xValue(pArg, pValue) : XJD1_ERROR;
+      }else if( iStart>=0 ){
+        rc = XJD1_ERROR;
+      }
+      break;
+    }
+
+    c = zBuf[i];
+    if( iStart<0 ){
+      /* Between values */
+      if( xjd1Isspace(c) ){
+        i++;
+        continue;
+      }
+      if( eMode==JSON_EACH_UNKNOWN ){
+        if( c=='[' ){
+          eMode = JSON_EACH_ARRAY;
+          i++;
+          continue;
+        }
+        eMode = JSON_EACH_SEQUENCE;
+      }
+      if( eMode==JSON_EACH_ARRAY ){
+        if( c==']' || c==',' ){
+          /* "," must follow an element.  "]" must not follow "," */
+          if( c==',' ? !bElem : bComma ) rc = XJD1_ERROR;
+          if( c==']' ) eMode = JSON_EACH_DONE;
+          bComma = c==',';
+          bElem = 0;
+          i++;
+          continue;
+        }
+        if( bElem ){
+          rc = XJD1_ERROR;
+          break;
+        }
+      }
+      if( eMode==JSON_EACH_DONE ){
+        rc = XJD1_ERROR;
+        break;
+      }
+      iStart = i;
+    }
+
+    /* Inside a value */
+    if( inStr ){
+      if( c=='\\' ){
+        i++;
+      }else if( c=='"' ){
+        inStr = 0;
+      }
+    }else{
+      switch( c ){
+        case '"': {
+          inStr = 1;
+          break;
+        }
+        case '{':
+        case '[': {
+          nDepth++;
+          break;
+        }
+        case '}':
+        case ']': {
+          if( nDepth>0 ){
+            nDepth--;
+            if( nDepth==0 && eMode==JSON_EACH_SEQUENCE ) iEnd = i+1;
+          }else if( c==']' && eMode==JSON_EACH_ARRAY ){
+            iEnd = i;
+          }else{
+            rc = XJD1_ERROR;
+          }
+          break;
+        }
+        case ',': {
+          if( nDepth==0 && eMode==JSON_EACH_ARRAY ) iEnd = i;
+          break;
+        }
+        default: {
+          if( nDepth==0 && xjd1Isspace(c) ) iEnd = i;
+          break;
+        }
+      }
+    }
+    if( iEnd<0 ){
+      i++;
+    }else{
+      JsonNode *pValue = jsonParseOne(&zBuf[iStart], iEnd-iStart);
+      rc = pValue ? xValue(pArg, pValue) : XJD1_ERROR;
+      iStart = -1;
+      bElem = 1;
+      bComma = 0;
+      i = iEnd;
+    }
+  }
+  xjd1_free(zBuf);
+  return rc;
 }
 
 /*
@@ -755,6 +1832,10 @@ int xjd1JsonTidy(String *pOut, const char *zIn){
   x.iCur = 0;
   x.n = 0;
   x.eType = 0;
+  x.bEscape = 0;
+  x.nSpace = 0;
+  x.nDirty = 0;
+  x.pSrc = 0;
 
   while( 1 ){
     int ePrev = x.eType;
@@ -793,33 +1874,48 @@ int xjd1JsonTidy(String *pOut, const char *zIn){
 ** XJD1_NOMEM if an OOM error is encountered.
 */
 int xjd1JsonInsert(JsonNode *p, const char *zLabel, JsonNode *pVal){
-  JsonStructElem *pElem;
+  JsonShape *pOld, *pShape;
+  JsonNode **apNew;
+  char **azLabel;
+  int *anLabel;
+  int i, n;
 
   assert( p && p->eJType==XJD1_STRUCT && p->nRef==1 );
-  for(pElem=p->u.st.pFirst; pElem; pElem=pElem->pNext){
-    if( strcmp(zLabel, pElem->zLabel)==0 ) break;
+  xjd1JsonDropSpan(p);
+  i = xjd1JsonStructFind(p, zLabel, -1);
+  if( i>=0 ){
+    xjd1JsonFree(p->u.st.apValue[i]);
+    p->u.st.apValue[i] = pVal;
+    return XJD1_OK;
   }
-  if( pElem ){
-    xjd1_free(pElem->zLabel);
-    xjd1JsonFree(pElem->pValue);
-  }else{
-    pElem = xjd1_malloc(sizeof(*pElem));
-    if( !pElem ){
-      xjd1JsonFree(pVal);
-      return XJD1_NOMEM;
-    }
 
-    if( p->u.st.pLast ){
-      p->u.st.pLast->pNext = pElem;
-    }else{
-      p->u.st.pFirst = pElem;
-    }
-    pElem->pNext = 0;
-    p->u.st.pLast = pElem;
+  /* Find or create the shape that has zLabel appended to the current
+  ** shape of p. */
+  pOld = p->u.st.pShape;
+  n = xjd1JsonStructCount(p);
+  azLabel = xjd1_malloc( (sizeof(char*)+sizeof(int))*(n+1) );
+  if( azLabel==0 ){
+    xjd1JsonFree(pVal);
+    return XJD1_NOMEM;
   }
-
-  pElem->pValue = pVal;
-  pElem->zLabel = xjd1PoolDup(0, zLabel, -1);
-  return (pElem->zLabel ? XJD1_OK : XJD1_NOMEM);
+  anLabel = (int*)&azLabel[n+1];
+  for(i=0; i<n; i++){
+    azLabel[i] = pOld->azLabel[i];
+    anLabel[i] = pOld->anLabel[i];
+  }
+  azLabel[n] = (char*)zLabel;
+  anLabel[n] = xjd1Strlen30(zLabel);
+  pShape = xjd1JsonShapeNew(n+1, azLabel, anLabel);
+  xjd1_free(azLabel);
+  apNew = pShape ? xjd1_realloc(p->u.st.apValue, sizeof(JsonNode*)*(n+1)) : 0;
+  if( apNew==0 ){
+    xjd1JsonShapeUnref(pShape);
+    xjd1JsonFree(pVal);
+    return XJD1_NOMEM;
+  }
+  apNew[n] = pVal;
+  p->u.st.apValue = apNew;
+  p->u.st.pShape = pShape;
+  xjd1JsonShapeUnref(pOld);
+  return XJD1_OK;
 }
-
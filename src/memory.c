@@ -80,18 +80,46 @@ void xjd1PoolDelete(Pool *p){
   }
 }
 
+/*
+** Free every chunk on a list of PoolChunk objects.
+*/
+static void poolFreeChunks(PoolChunk *pChunk){
+  PoolChunk *pNext;
+  for(; pChunk; pChunk = pNext){
+    pNext = pChunk->pNext;
+    xjd1_free(pChunk);
+  }
+}
+
 /*
 ** Clear a memory allocation pool.  That is to say, xjd1_free all the
 ** memory allocations associated with the pool, though do not xjd1_free
 ** the memory pool itself.
 */
 void xjd1PoolClear(Pool *p){
+  poolFreeChunks(p->pChunk);
+  poolFreeChunks(p->pLarge);
+  poolFreeChunks(p->pFree);
+  memset(p, 0, sizeof(*p));
+}
+
+/*
+** Discard all allocations made from a pool, but keep its chunks of
+** memory so that they can satisfy later allocations without calling
+** xjd1_malloc() again.  Oversized allocations are freed.
+*/
+void xjd1PoolReset(Pool *p){
   PoolChunk *pChunk, *pNext;
+  poolFreeChunks(p->pLarge);
+  p->pLarge = 0;
   for(pChunk = p->pChunk; pChunk; pChunk = pNext){
     pNext = pChunk->pNext;
-    xjd1_free(pChunk);
+    pChunk->pNext = p->pFree;
+    p->pFree = pChunk;
   }
-  memset(p, 0, sizeof(*p));
+  p->pChunk = 0;
+  p->pSpace = 0;
+  p->nSpace = 0;
 }
 
 /*
@@ -103,14 +131,19 @@ void *xjd1PoolMalloc(Pool *p, int N){
   if( N>POOL_CHUNK_SIZE/4 ){
     PoolChunk *pChunk = xjd1_malloc( N + 8 );
     if( pChunk==0 ) return 0;
-    pChunk->pNext = p->pChunk;
-    p->pChunk = pChunk;
+    pChunk->pNext = p->pLarge;
+    p->pLarge = pChunk;
     return &((char*)pChunk)[8];
   }else{
     void *x;
     if( p->nSpace<N ){
-      PoolChunk *pChunk = xjd1_malloc( POOL_CHUNK_SIZE + 8 );
-      if( pChunk==0 ) return 0;
+      PoolChunk *pChunk = p->pFree;
+      if( pChunk ){
+        p->pFree = pChunk->pNext;
+      }else{
+        pChunk = xjd1_malloc( POOL_CHUNK_SIZE + 8 );
+        if( pChunk==0 ) return 0;
+      }
       pChunk->pNext = p->pChunk;
       p->pChunk = pChunk;
       p->pSpace = (char*)pChunk;
@@ -0,0 +1,569 @@
+/*
+** Copyright (c) 2011 D. Richard Hipp
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the Simplified BSD License (also
+** known as the "2-Clause License" or "FreeBSD License".)
+**
+** This program is distributed in the hope that it will be useful,
+** but without any warranty; without even the implied warranty of
+** merchantability or fitness for a particular purpose.
+**
+** Author contact information:
+**   drh@hwaci.com
+**   http://www.hwaci.com/drh/
+**
+*************************************************************************
+** This file contains code used to convert numbers to and from text.
+**
+** Reals are rendered using the Grisu2 algorithm by Florian Loitsch
+** ("Printing Floating-Point Numbers Quickly and Accurately with
+** Integers", PLDI 2010).  The output is the shortest (or very nearly the
+** shortest) string of digits that converts back to the same double.
+*/
+#include "xjd1Int.h"
+
+/*
+** A floating point number with a 64-bit significand and no implied bits.
+** The value is f*2^e.
+*/
+typedef struct DiyFp DiyFp;
+struct DiyFp {
+  u64 f;
+  int e;
+};
+
+/*
+** Normalized powers of ten.  aPow10F[i]*2^aPow10E[i] is the closest
+** approximation to 10^(8*i-348).
+*/
+static const u64 aPow10F[] = {
+  XJD1_U64(0xfa8fd5a0,0x081c0288), XJD1_U64(0xbaaee17f,0xa23ebf76),
+  XJD1_U64(0x8b16fb20,0x3055ac76), XJD1_U64(0xcf42894a,0x5dce35ea),
+  XJD1_U64(0x9a6bb0aa,0x55653b2d), XJD1_U64(0xe61acf03,0x3d1a45df),
+  XJD1_U64(0xab70fe17,0xc79ac6ca), XJD1_U64(0xff77b1fc,0xbebcdc4f),
+  XJD1_U64(0xbe5691ef,0x416bd60c), XJD1_U64(0x8dd01fad,0x907ffc3c),
+  XJD1_U64(0xd3515c28,0x31559a83), XJD1_U64(0x9d71ac8f,0xada6c9b5),
+  XJD1_U64(0xea9c2277,0x23ee8bcb), XJD1_U64(0xaecc4991,0x4078536d),
+  XJD1_U64(0x823c1279,0x5db6ce57), XJD1_U64(0xc2109436,0x4dfb5637),
+  XJD1_U64(0x9096ea6f,0x3848984f), XJD1_U64(0xd77485cb,0x25823ac7),
+  XJD1_U64(0xa086cfcd,0x97bf97f4), XJD1_U64(0xef340a98,0x172aace5),
+  XJD1_U64(0xb23867fb,0x2a35b28e), XJD1_U64(0x84c8d4df,0xd2c63f3b),
+  XJD1_U64(0xc5dd4427,0x1ad3cdba), XJD1_U64(0x936b9fce,0xbb25c996),
+  XJD1_U64(0xdbac6c24,0x7d62a584), XJD1_U64(0xa3ab6658,0x0d5fdaf6),
+  XJD1_U64(0xf3e2f893,0xdec3f126), XJD1_U64(0xb5b5ada8,0xaaff80b8),
+  XJD1_U64(0x87625f05,0x6c7c4a8b), XJD1_U64(0xc9bcff60,0x34c13053),
+  XJD1_U64(0x964e858c,0x91ba2655), XJD1_U64(0xdff97724,0x70297ebd),
+  XJD1_U64(0xa6dfbd9f,0xb8e5b88f), XJD1_U64(0xf8a95fcf,0x88747d94),
+  XJD1_U64(0xb9447093,0x8fa89bcf), XJD1_U64(0x8a08f0f8,0xbf0f156b),
+  XJD1_U64(0xcdb02555,0x653131b6), XJD1_U64(0x993fe2c6,0xd07b7fac),
+  XJD1_U64(0xe45c10c4,0x2a2b3b06), XJD1_U64(0xaa242499,0x697392d3),
+  XJD1_U64(0xfd87b5f2,0x8300ca0e), XJD1_U64(0xbce50864,0x92111aeb),
+  XJD1_U64(0x8cbccc09,0x6f5088cc), XJD1_U64(0xd1b71758,0xe219652c),
+  XJD1_U64(0x9c400000,0x00000000), XJD1_U64(0xe8d4a510,0x00000000),
+  XJD1_U64(0xad78ebc5,0xac620000), XJD1_U64(0x813f3978,0xf8940984),
+  XJD1_U64(0xc097ce7b,0xc90715b3), XJD1_U64(0x8f7e32ce,0x7bea5c70),
+  XJD1_U64(0xd5d238a4,0xabe98068), XJD1_U64(0x9f4f2726,0x179a2245),
+  XJD1_U64(0xed63a231,0xd4c4fb27), XJD1_U64(0xb0de6538,0x8cc8ada8),
+  XJD1_U64(0x83c7088e,0x1aab65db), XJD1_U64(0xc45d1df9,0x42711d9a),
+  XJD1_U64(0x924d692c,0xa61be758), XJD1_U64(0xda01ee64,0x1a708dea),
+  XJD1_U64(0xa26da399,0x9aef774a), XJD1_U64(0xf209787b,0xb47d6b85),
+  XJD1_U64(0xb454e4a1,0x79dd1877), XJD1_U64(0x865b8692,0x5b9bc5c2),
+  XJD1_U64(0xc83553c5,0xc8965d3d), XJD1_U64(0x952ab45c,0xfa97a0b3),
+  XJD1_U64(0xde469fbd,0x99a05fe3), XJD1_U64(0xa59bc234,0xdb398c25),
+  XJD1_U64(0xf6c69a72,0xa3989f5c), XJD1_U64(0xb7dcbf53,0x54e9bece),
+  XJD1_U64(0x88fcf317,0xf22241e2), XJD1_U64(0xcc20ce9b,0xd35c78a5),
+  XJD1_U64(0x98165af3,0x7b2153df), XJD1_U64(0xe2a0b5dc,0x971f303a),
+  XJD1_U64(0xa8d9d153,0x5ce3b396), XJD1_U64(0xfb9b7cd9,0xa4a7443c),
+  XJD1_U64(0xbb764c4c,0xa7a44410), XJD1_U64(0x8bab8eef,0xb6409c1a),
+  XJD1_U64(0xd01fef10,0xa657842c), XJD1_U64(0x9b10a4e5,0xe9913129),
+  XJD1_U64(0xe7109bfb,0xa19c0c9d), XJD1_U64(0xac2820d9,0x623bf429),
+  XJD1_U64(0x80444b5e,0x7aa7cf85), XJD1_U64(0xbf21e440,0x03acdd2d),
+  XJD1_U64(0x8e679c2f,0x5e44ff8f), XJD1_U64(0xd433179d,0x9c8cb841),
+  XJD1_U64(0x9e19db92,0xb4e31ba9), XJD1_U64(0xeb96bf6e,0xbadf77d9),
+  XJD1_U64(0xaf87023b,0x9bf0ee6b)
+};
+static const short aPow10E[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+  -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+  -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+  -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+  -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+  109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+  641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+  907, 933, 960, 986, 1013, 1039, 1066
+};
+
+/* Powers of ten that fit in 64 bits */
+static const u64 aPow10[] = {
+  XJD1_U64(0x00000000,0x00000001), XJD1_U64(0x00000000,0x0000000a),
+  XJD1_U64(0x00000000,0x00000064), XJD1_U64(0x00000000,0x000003e8),
+  XJD1_U64(0x00000000,0x00002710), XJD1_U64(0x00000000,0x000186a0),
+  XJD1_U64(0x00000000,0x000f4240), XJD1_U64(0x00000000,0x00989680),
+  XJD1_U64(0x00000000,0x05f5e100), XJD1_U64(0x00000000,0x3b9aca00),
+  XJD1_U64(0x00000002,0x540be400), XJD1_U64(0x00000017,0x4876e800),
+  XJD1_U64(0x000000e8,0xd4a51000), XJD1_U64(0x00000918,0x4e72a000),
+  XJD1_U64(0x00005af3,0x107a4000), XJD1_U64(0x00038d7e,0xa4c68000),
+  XJD1_U64(0x002386f2,0x6fc10000), XJD1_U64(0x01634578,0x5d8a0000),
+  XJD1_U64(0x0de0b6b3,0xa7640000), XJD1_U64(0x8ac72304,0x89e80000)
+};
+
+/*
+** Return the product of two DiyFp values, rounded to 64 bits.
+*/
+static DiyFp diyFpMul(DiyFp x, DiyFp y){
+  const u64 M32 = 0xffffffff;
+  u64 a = x.f>>32, b = x.f & M32;
+  u64 c = y.f>>32, d = y.f & M32;
+  u64 ac = a*c, bc = b*c, ad = a*d, bd = b*d;
+  u64 tmp = (bd>>32) + (ad & M32) + (bc & M32);
+  DiyFp r;
+  tmp += (u64)1<<31;   /* Round */
+  r.f = ac + (ad>>32) + (bc>>32) + (tmp>>32);
+  r.e = x.e + y.e + 64;
+  return r;
+}
+
+/*
+** Shift the significand of x left until its most significant bit is set.
+*/
+static DiyFp diyFpNormalize(DiyFp x){
+  while( (x.f & ((u64)1<<63))==0 ){
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+/*
+** Compute the boundaries m- and m+ of the positive, finite double v.
+** Any number strictly between the two rounds to v.  Both boundaries are
+** returned with the exponent of the normalized m+.
+*/
+static void diyFpBoundaries(DiyFp v, DiyFp *pMinus, DiyFp *pPlus){
+  DiyFp pl, mi;
+  pl.f = (v.f<<1) + 1;
+  pl.e = v.e - 1;
+  pl = diyFpNormalize(pl);
+  if( v.f==((u64)1<<52) ){
+    /* The gap below a power of two is half the gap above it */
+    mi.f = (v.f<<2) - 1;
+    mi.e = v.e - 2;
+  }else{
+    mi.f = (v.f<<1) - 1;
+    mi.e = v.e - 1;
+  }
+  mi.f <<= mi.e - pl.e;
+  mi.e = pl.e;
+  *pMinus = mi;
+  *pPlus = pl;
+}
+
+/*
+** Move the last digit of the zBuf[] toward w as long as the result stays
+** within the rounding interval.
+*/
+static void grisuRound(
+  char *zBuf, int nBuf,      /* Digits generated so far */
+  u64 delta,                 /* Width of the rounding interval */
+  u64 rest,                  /* Distance from the digits to the top */
+  u64 tenKappa,              /* Weight of the last digit */
+  u64 wpw                    /* Distance from w to the top */
+){
+  while( rest<wpw && delta-rest>=tenKappa
+      && (rest+tenKappa<wpw || wpw-rest>rest+tenKappa-wpw)
+  ){
+    zBuf[nBuf-1]--;
+    rest += tenKappa;
+  }
+}
+
+/*
+** Generate the shortest digits of a number in the range [Mp-delta, Mp]
+** that is as close to W as possible.  The number of digits is written
+** to *pnBuf and the decimal exponent is added to *pK.
+*/
+static void grisuDigits(
+  DiyFp W, DiyFp Mp, u64 delta,
+  char *zBuf, int *pnBuf, int *pK
+){
+  int sh = -Mp.e;
+  u64 one = (u64)1<<sh;
+  u64 wpw = Mp.f - W.f;
+  u32 p1 = (u32)(Mp.f>>sh);
+  u64 p2 = Mp.f & (one-1);
+  int kappa;
+  int n = 0;
+  for(kappa=1; kappa<10 && p1>=aPow10[kappa]; kappa++){}
+  while( kappa>0 ){
+    u32 d = p1/(u32)aPow10[kappa-1];
+    p1 %= (u32)aPow10[kappa-1];
+    if( d || n ) zBuf[n++] = '0' + (char)d;
+    kappa--;
+    if( (((u64)p1)<<sh) + p2 <= delta ){
+      *pK += kappa;
+      *pnBuf = n;
+      grisuRound(zBuf, n, delta, (((u64)p1)<<sh) + p2,
+                 aPow10[kappa]<<sh, wpw);
+      return;
+    }
+  }
+  while( 1 ){
+    char d;
+    p2 *= 10;
+    delta *= 10;
+    d = (char)(p2>>sh);
+    if( d || n ) zBuf[n++] = '0' + d;
+    p2 &= one-1;
+    kappa--;
+    if( p2<delta ){
+      *pK += kappa;
+      *pnBuf = n;
+      grisuRound(zBuf, n, delta, p2, one,
+                 -kappa<20 ? wpw*aPow10[-kappa] : 0);
+      return;
+    }
+  }
+}
+
+/*
+** Compute the shortest digits of positive, finite r.  The value is
+** zBuf[0..*pnBuf-1] times 10^*pK.  zBuf[] must have room for 18 digits.
+*/
+static void grisu2(double r, char *zBuf, int *pnBuf, int *pK){
+  DiyFp v, mi, pl, c, W, Wp, Wm;
+  u64 bits;
+  int biased, k, idx;
+  double dk;
+
+  memcpy(&bits, &r, sizeof(bits));
+  biased = (int)((bits>>52) & 0x7ff);
+  v.f = bits & (((u64)1<<52)-1);
+  if( biased ){
+    v.f += (u64)1<<52;
+    v.e = biased - 1075;
+  }else{
+    v.e = -1074;
+  }
+  diyFpBoundaries(v, &mi, &pl);
+
+  /* Find a cached power of ten c such that the exponent of pl*c lies
+  ** in the range -60..-32 */
+  dk = (-61 - pl.e)*0.30102999566398114 + 347;
+  k = (int)dk;
+  if( dk-k>0.0 ) k++;
+  idx = (k>>3) + 1;
+  *pK = -(-348 + idx*8);
+  c.f = aPow10F[idx];
+  c.e = aPow10E[idx];
+
+  W = diyFpMul(diyFpNormalize(v), c);
+  Wp = diyFpMul(pl, c);
+  Wm = diyFpMul(mi, c);
+  Wm.f++;
+  Wp.f--;
+  grisuDigits(W, Wp, Wp.f-Wm.f, zBuf, pnBuf, pK);
+}
+
+/*
+** Grisu2 occasionally returns 16 or 17 digits for a number that has a
+** shorter representation (1e23 comes out as 9.999999999999999e+22).  Any
+** double that can be written in 15 or fewer digits is found by rounding
+** to 15 digits, so try that and keep the result if it reads back as r.
+*/
+static void shortenDigits(double r, char *zDigit, int *pnDigit, int *pK){
+  char zTry[40];
+  int nTry = 15;
+  int kTry = *pK + *pnDigit - 15;
+  int i, n;
+  i64 v;
+  double r2;
+
+  memcpy(zTry, zDigit, 15);
+  if( zDigit[15]>='5' ){
+    for(i=14; i>=0 && zTry[i]=='9'; i--) zTry[i] = '0';
+    if( i<0 ){
+      zTry[0] = '1';
+      nTry = 1;
+      kTry += 15;
+    }else{
+      zTry[i]++;
+    }
+  }
+  while( nTry>1 && zTry[nTry-1]=='0' ){
+    nTry--;
+    kTry++;
+  }
+  n = nTry;
+  zTry[n++] = 'e';
+  n += xjd1IntToText(kTry, &zTry[n]);
+  if( xjd1TextToNumber(zTry, n, &v, &r2)==XJD1_REAL && r2==r ){
+    memcpy(zDigit, zTry, nTry);
+    *pnDigit = nTry;
+    *pK = kTry;
+  }
+}
+
+/*
+** Write the decimal text of integer v into zOut[] and return the number
+** of bytes written.  zOut[] must have room for 21 bytes.  No terminator
+** is written.
+*/
+int xjd1IntToText(i64 v, char *zOut){
+  char zBuf[24];
+  int i = sizeof(zBuf);
+  u64 x = v<0 ? -(u64)v : (u64)v;
+  do{
+    zBuf[--i] = '0' + (int)(x%10);
+    x /= 10;
+  }while( x );
+  if( v<0 ) zBuf[--i] = '-';
+  memcpy(zOut, &zBuf[i], sizeof(zBuf)-i);
+  return (int)sizeof(zBuf)-i;
+}
+
+/*
+** Write the text of real number r into zOut[] and return the number of
+** bytes written.  zOut[] must have room for XJD1_REAL_TEXT bytes.  No
+** terminator is written.
+**
+** The format is that of printf("%.17g"), except that only as many digits
+** are used as are needed to get r back again.  JSON has no way to write
+** an infinity or a NaN, so those are rendered as null.
+*/
+int xjd1RealToText(double r, char *zOut){
+  char zDigit[20];
+  int nDigit, K, X, i, n = 0;
+  u64 bits;
+
+  memcpy(&bits, &r, sizeof(bits));
+  if( ((bits>>52) & 0x7ff)==0x7ff ){
+    memcpy(zOut, "null", 4);
+    return 4;
+  }
+  if( bits>>63 ){
+    zOut[n++] = '-';
+    r = -r;
+  }
+  if( r==0.0 ){
+    zOut[n++] = '0';
+    return n;
+  }
+  if( r<1e17 && r==(double)(i64)r ){
+    /* Integers print exactly, so no search for digits is needed */
+    return n + xjd1IntToText((i64)r, &zOut[n]);
+  }
+  grisu2(r, zDigit, &nDigit, &K);
+  if( nDigit>15 ) shortenDigits(r, zDigit, &nDigit, &K);
+
+  /* X is the decimal exponent of the first digit */
+  X = nDigit + K - 1;
+  if( X<-4 || X>=17 ){
+    zOut[n++] = zDigit[0];
+    if( nDigit>1 ){
+      zOut[n++] = '.';
+      memcpy(&zOut[n], &zDigit[1], nDigit-1);
+      n += nDigit-1;
+    }
+    zOut[n++] = 'e';
+    if( X<0 ){
+      zOut[n++] = '-';
+      X = -X;
+    }else{
+      zOut[n++] = '+';
+    }
+    if( X>=100 ){
+      zOut[n++] = '0' + X/100;
+      X %= 100;
+    }
+    zOut[n++] = '0' + X/10;
+    zOut[n++] = '0' + X%10;
+  }else if( X<0 ){
+    zOut[n++] = '0';
+    zOut[n++] = '.';
+    for(i=X+1; i<0; i++) zOut[n++] = '0';
+    memcpy(&zOut[n], zDigit, nDigit);
+    n += nDigit;
+  }else if( nDigit<=X+1 ){
+    memcpy(&zOut[n], zDigit, nDigit);
+    n += nDigit;
+    for(i=nDigit; i<=X; i++) zOut[n++] = '0';
+  }else{
+    memcpy(&zOut[n], zDigit, X+1);
+    n += X+1;
+    zOut[n++] = '.';
+    memcpy(&zOut[n], &zDigit[X+1], nDigit-X-1);
+    n += nDigit-X-1;
+  }
+  return n;
+}
+
+/*
+** Powers of ten that are exactly representable as doubles.
+*/
+static const double aExactPow10[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+  1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+  1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+** Convert the n bytes of z[] into a real number using strtod().  This is
+** the slow path of xjd1TextToNumber(), used only when the fast path
+** might round incorrectly.  z[] has already been checked.
+**
+** The decimal point that strtod() accepts depends on the locale, so the
+** text is first rewritten without one:  "-12.5e3" becomes "-125e2".
+*/
+static double slowTextToReal(const char *z, int n){
+  char zBuf[100];
+  char *zCopy = zBuf;
+  int nFrac = -1;             /* Digits after the '.', or -1 if no '.' */
+  int x = 0;                  /* Value of the exponent */
+  int eNeg = 0;               /* True if the exponent is negative */
+  int i, j = 0;
+  double r;
+
+  if( n+XJD1_REAL_TEXT>(int)sizeof(zBuf) ){
+    zCopy = xjd1_malloc( n+XJD1_REAL_TEXT );
+    if( zCopy==0 ) return 0.0;
+  }
+  for(i=0; i<n && z[i]!='e' && z[i]!='E'; i++){
+    if( z[i]=='.' ){
+      nFrac = 0;
+    }else{
+      zCopy[j++] = z[i];
+      if( nFrac>=0 ) nFrac++;
+    }
+  }
+  if( i<n ){
+    i++;
+    if( z[i]=='+' || z[i]=='-' ){
+      eNeg = z[i]=='-';
+      i++;
+    }
+    for(; i<n; i++){
+      if( x<100000 ) x = x*10 + z[i] - '0';
+    }
+  }
+  if( eNeg ) x = -x;
+  if( nFrac>0 ) x -= nFrac;
+  zCopy[j++] = 'e';
+  j += xjd1IntToText(x, &zCopy[j]);
+  zCopy[j] = 0;
+  r = strtod(zCopy, 0);
+  if( zCopy!=zBuf ) xjd1_free(zCopy);
+  return r;
+}
+
+/*
+** Convert the n bytes of z[] into a number.  The text is an optional
+** '-', digits with an optional '.', and an optional exponent.  There must
+** be at least one digit before the exponent.  z[] need not be terminated,
+** so this can be used on a token in the middle of a larger text.
+**
+** If the text is an integer that fits in 64 bits, write its value into
+** *piVal and return XJD1_INT.  Otherwise write the nearest double into
+** *prVal and return XJD1_REAL.  Return 0 if the text is not a number.
+**
+** Most numbers have few enough digits that the significand is exact in a
+** double, and a small enough exponent that the power of ten is exact
+** too.  One IEEE multiply or divide then rounds correctly (Clinger's
+** fast path).  The few numbers that fail those tests go to strtod().
+*/
+int xjd1TextToNumber(const char *z, int n, i64 *piVal, double *prVal){
+  u64 m = 0;                  /* Up to the first 19 significant digits */
+  int nSig = 0;               /* Significant digits in m */
+  int bTrunc = 0;             /* True if non-zero digits were left out of m */
+  int e10 = 0;                /* Value is m*10^e10 */
+  int nDigit = 0;             /* Digits seen before the exponent */
+  int isInt = 1;              /* No '.' and no exponent */
+  int neg = 0;                /* True for a leading '-' */
+  int i = 0, d;
+  double r;
+
+  if( i<n && z[i]=='-' ){
+    neg = 1;
+    i++;
+  }
+  for(; i<n && xjd1Isdigit(z[i]); i++){
+    d = z[i] - '0';
+    nDigit++;
+    if( nSig<19 ){
+      m = m*10 + d;
+      if( m ) nSig++;
+    }else{
+      e10++;
+      if( d ) bTrunc = 1;
+    }
+  }
+  if( i<n && z[i]=='.' ){
+    isInt = 0;
+    for(i++; i<n && xjd1Isdigit(z[i]); i++){
+      d = z[i] - '0';
+      nDigit++;
+      if( nSig<19 ){
+        m = m*10 + d;
+        if( m ) nSig++;
+        e10--;
+      }else if( d ){
+        bTrunc = 1;
+      }
+    }
+  }
+  if( nDigit==0 ) return 0;
+  if( i<n && (z[i]=='e' || z[i]=='E') ){
+    int eNeg = 0, x = 0, nExp = 0;
+    isInt = 0;
+    i++;
+    if( i<n && (z[i]=='+' || z[i]=='-') ){
+      eNeg = z[i]=='-';
+      i++;
+    }
+    for(; i<n && xjd1Isdigit(z[i]); i++){
+      if( x<100000 ) x = x*10 + z[i] - '0';
+      nExp++;
+    }
+    if( nExp==0 ) return 0;
+    e10 += eNeg ? -x : x;
+  }
+  if( i<n ) return 0;
+
+  if( isInt && e10==0 && (m || !neg) ){
+    /* An integer.  "-0" is left a real so that the sign is kept. */
+    if( neg && m<=(u64)LARGEST_INT64+1 ){
+      *piVal = m>(u64)LARGEST_INT64 ? SMALLEST_INT64 : -(i64)m;
+      return XJD1_INT;
+    }
+    if( !neg && m<=(u64)LARGEST_INT64 ){
+      *piVal = (i64)m;
+      return XJD1_INT;
+    }
+  }
+
+  if( m==0 && !bTrunc ){
+    r = 0.0;
+  }else if( bTrunc || m>((u64)1<<53) ){
+    r = slowTextToReal(z, n);
+    neg = 0;
+  }else if( e10>=0 && e10<=22 ){
+    r = (double)m * aExactPow10[e10];
+  }else if( e10<0 && e10>=-22 ){
+    r = (double)m / aExactPow10[-e10];
+  }else if( e10>22 && e10<=22+15 ){
+    /* m*10^(e10-22) may still be an exact integer */
+    for(; e10>22 && m<=((u64)1<<53)/10; e10--) m *= 10;
+    if( e10==22 ){
+      r = (double)m * aExactPow10[22];
+    }else{
+      r = slowTextToReal(z, n);
+      neg = 0;
+    }
+  }else{
+    r = slowTextToReal(z, n);
+    neg = 0;
+  }
+  *prVal = neg ? -r : r;
+  return XJD1_REAL;
+}
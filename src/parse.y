@@ -68,34 +68,43 @@ input ::= cmd(X) SEMI.   {p->pCmd = X;}
 //
 
 %include {
-  /* A JSON literal for a real number */
-  static JsonNode *jsonReal(Parse *p, Token *pTok){
+  /* A JSON literal for an integer or real number */
+  static JsonNode *jsonNumber(Parse *p, Token *pTok){
     JsonNode *pNew = xjd1JsonNew(p->pPool);
     if( pNew ){
-      pNew->eJType = XJD1_REAL;
-      pNew->u.r = atof(pTok->z);
+      xjd1JsonSetNumber(pNew, pTok->z, pTok->n);
     }
     return pNew;
   }
 
-  /* Convert a token into a zero-terminated string */
-  static char *tokenStr(Parse *p, Token *pTok){
+  /* Convert a token into a zero-terminated string.  If pnOut is not NULL,
+  ** the length of the result in bytes is written to *pnOut. */
+  static char *tokenStrN(Parse *p, Token *pTok, int *pnOut){
     char *z;
+    int n = 0;
     if( pTok ){
       z = xjd1PoolDup(p->pPool, pTok->z, pTok->n);
-      if( z && z[0]=='"' ) xjd1DequoteString(z, pTok->n);
+      if( z ){
+        n = pTok->n;
+        if( z[0]=='"' ) n = xjd1DequoteString(z, pTok->n);
+      }
     }else{
       z = 0;
     }
+    if( pnOut ) *pnOut = n;
     return z;
   }
+  static char *tokenStr(Parse *p, Token *pTok){
+    return tokenStrN(p, pTok, 0);
+  }
 
   /* A JSON literal for a string */
   static JsonNode *jsonString(Parse *p, Token *pTok){
     JsonNode *pNew = xjd1JsonNew(p->pPool);
     if( pNew ){
       pNew->eJType = XJD1_STRING;
-      pNew->u.z = tokenStr(p, pTok);
+      pNew->eStr = XJD1_STR_STATIC;
+      pNew->u.str.z = tokenStrN(p, pTok, &pNew->u.str.n);
     }
     return pNew;
   }
@@ -110,8 +119,8 @@ input ::= cmd(X) SEMI.   {p->pCmd = X;}
   }
 }
 %type jvalue {JsonNode*}
-jvalue(A) ::= INTEGER(X).              {A = jsonReal(p,&X);}
-jvalue(A) ::= FLOAT(X).                {A = jsonReal(p,&X);}
+jvalue(A) ::= INTEGER(X).              {A = jsonNumber(p,&X);}
+jvalue(A) ::= FLOAT(X).                {A = jsonNumber(p,&X);}
 jvalue(A) ::= STRING(X).               {A = jsonString(p,&X);}
 jvalue(A) ::= TRUE.                    {A = jsonType(p,XJD1_TRUE);}
 jvalue(A) ::= FALSE.                   {A = jsonType(p,XJD1_FALSE);}
@@ -248,6 +257,35 @@ jvalue(A) ::= NULL.                    {A = jsonType(p,XJD1_NULL);}
     return pNew;
   }
 
+  /* Generate an Expr object for a "?" parameter (pName==0) or a ":name"
+  ** parameter.  Each "?" is a new parameter.  All uses of the same ":name"
+  ** refer to a single parameter. */
+  static Expr *paramExpr(Parse *p, Token *pName){
+    Expr *pNew = xjd1PoolMallocZero(p->pPool, sizeof(*pNew));
+    if( pNew ){
+      char *zName = tokenStr(p, pName);
+      int i = p->nParam;
+      if( zName ){
+        for(i=0; i<p->nParam; i++){
+          if( p->azParam[i] && strcmp(p->azParam[i], zName)==0 ) break;
+        }
+      }
+      if( i==p->nParam ){
+        char **azNew = xjd1PoolMalloc(p->pPool, sizeof(char*)*(i+1));
+        if( azNew==0 ) return 0;
+        if( i>0 ) memcpy(azNew, p->azParam, sizeof(char*)*i);
+        azNew[i] = zName;
+        p->azParam = azNew;
+        p->nParam++;
+      }
+      pNew->eType = TK_PARAM;
+      pNew->eClass = XJD1_EXPR_PARAM;
+      pNew->u.param.iParam = i;
+      pNew->u.param.zName = zName;
+    }
+    return pNew;
+  }
+
   /* Append a new expression to an expression list.  Allocate the
   ** expression list object if necessary. */
   static ExprList *apndExpr(Parse *p, ExprList *pList, Expr *pExpr, Token *pT){
@@ -282,6 +320,8 @@ lvalue(A) ::= lvalue(X) LB expr(Y) RB. {A = biExpr(p,X,TK_LB,Y);}
 %type expr {Expr*}
 expr(A) ::= lvalue(X).               {A = X;}
 expr(A) ::= jvalue(X).               {A = jsonExpr(p,X);}
+expr(A) ::= QM.                      {A = paramExpr(p,0);}
+expr(A) ::= COLON ID(X).             {A = paramExpr(p,&X);}
 expr(A) ::= LC structlist(X) RC.     {A = stExpr(p,X);}
 expr(A) ::= LC RC.                   {A = stExpr(p,0);}
 expr(A) ::= LB arraylist(X) RB.      {A = arExpr(p,X);}
@@ -582,9 +622,22 @@ where_opt(A) ::= WHERE expr(X).     {A = X;}
 
 ///////////////////// TRANSACTIONS ////////////////////////////
 //
-cmd ::= BEGIN ID.
-cmd ::= ROLLBACK ID.
-cmd ::= COMMIT ID.
+%include {
+  static Command *makeTrans(Parse *p, int eCmdType, Token *pName){
+    Command *pNew = xjd1PoolMallocZero(p->pPool, sizeof(*pNew));
+    if( pNew ){
+      pNew->eCmdType = eCmdType;
+      pNew->u.trans.zTransId = pName ? tokenStr(p, pName) : 0;
+    }
+    return pNew;
+  }
+}
+cmd(A) ::= BEGIN.                {A = makeTrans(p,TK_BEGIN,0);}
+cmd(A) ::= BEGIN ID(N).          {A = makeTrans(p,TK_BEGIN,&N);}
+cmd(A) ::= ROLLBACK.             {A = makeTrans(p,TK_ROLLBACK,0);}
+cmd(A) ::= ROLLBACK ID(N).       {A = makeTrans(p,TK_ROLLBACK,&N);}
+cmd(A) ::= COMMIT.               {A = makeTrans(p,TK_COMMIT,0);}
+cmd(A) ::= COMMIT ID(N).         {A = makeTrans(p,TK_COMMIT,&N);}
 
 ///////////////////// The CREATE COLLECTION statement ////////////////////////
 //
@@ -662,12 +715,23 @@ upsert_opt(A) ::= ELSE INSERT expr(X).    {A = X;}
 
 ////////////////////////// The INSERT command /////////////////////////////////
 //
-cmd(A) ::= async INSERT INTO tabname(N) VALUE expr(V). {
+cmd(A) ::= async(S) INSERT INTO tabname(N) VALUE expr(V). {
   Command *pNew = xjd1PoolMallocZero(p->pPool, sizeof(*pNew));
   if( pNew ){
     pNew->eCmdType = TK_INSERT;
     pNew->u.ins.zName = tokenStr(p, &N);
     pNew->u.ins.pValue = V;
+    pNew->u.ins.isAsync = S;
+  }
+  A = pNew;
+}
+cmd(A) ::= async(S) INSERT INTO tabname(N) VALUES nexprlist(L). {
+  Command *pNew = xjd1PoolMallocZero(p->pPool, sizeof(*pNew));
+  if( pNew ){
+    pNew->eCmdType = TK_INSERT;
+    pNew->u.ins.zName = tokenStr(p, &N);
+    pNew->u.ins.pList = L;
+    pNew->u.ins.isAsync = S;
   }
   A = pNew;
 }
@@ -680,9 +744,13 @@ cmd(A) ::= async INSERT INTO tabname(N) select(Q). {
   }
   A = pNew;
 }
-async ::= .
-async ::= ASYNC.
-async ::= SYNC.
+// An ASYNC INSERT ... VALUE or VALUES is queued on the connection and
+// written later.  See async.c.  INSERT ... SELECT is always synchronous.
+//
+%type async {int}
+async(A) ::= .          {A = 0;}
+async(A) ::= ASYNC.     {A = 1;}
+async(A) ::= SYNC.      {A = 0;}
 
 ////////////////////////// The PRAGMA command /////////////////////////////////
 //
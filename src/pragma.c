@@ -15,18 +15,223 @@
 **
 *************************************************************************
 ** Code to evaluate a pragma.
+**
+** "PRAGMA name" returns the current value of a setting as a single row.
+** "PRAGMA name=value" and "PRAGMA name(value)" change it and return
+** nothing.  Settings are either passed through to the storage engine or
+** are integer settings of the connection.
 */
 #include "xjd1Int.h"
 
 /*
-** Evaluate a pragma.
-**
-** Unknown pragmas are silently ignored.
+** Kinds of pragma.
+*/
+#define PRAGMA_SQLITE  1     /* Passed through to the storage engine */
+#define PRAGMA_INT     2     /* An integer setting of the connection */
+
+/*
+** Integer settings of the connection.  Values for PragmaDef.iSetting.
+*/
+#define PRAG_ASYNC_BATCH     1    /* sAsync.mxDoc */
+#define PRAG_ASYNC_WINDOW    2    /* sAsync.msWindow */
+#define PRAG_STMT_CACHE      3    /* mxCache */
+#define PRAG_WRITE_BUFFER    4    /* mxWriteBuf */
+
+/*
+** Definition of one pragma.
+*/
+typedef struct PragmaDef PragmaDef;
+struct PragmaDef {
+  const char *zName;      /* Name of the pragma */
+  u8 eKind;               /* PRAGMA_SQLITE or PRAGMA_INT */
+  u8 iSetting;            /* One of the PRAG_* values for PRAGMA_INT */
+};
+
+/*
+** All known pragmas, in alphabetical order.
+*/
+static const PragmaDef aPragma[] = {
+  { "async_batch",      PRAGMA_INT,     PRAG_ASYNC_BATCH   },
+  { "async_window",     PRAGMA_INT,     PRAG_ASYNC_WINDOW  },
+  { "cache_size",       PRAGMA_SQLITE,  0                  },
+  { "journal_mode",     PRAGMA_SQLITE,  0                  },
+  { "mmap_size",        PRAGMA_SQLITE,  0                  },
+  { "stmt_cache_size",  PRAGMA_INT,     PRAG_STMT_CACHE    },
+  { "synchronous",      PRAGMA_SQLITE,  0                  },
+  { "threads",          PRAGMA_SQLITE,  0                  },
+  { "write_buffer",     PRAGMA_INT,     PRAG_WRITE_BUFFER  },
+};
+
+/*
+** Find the definition of pragma zName, ignoring case.  Return NULL if
+** there is no such pragma.
+*/
+static const PragmaDef *pragmaFind(const char *zName){
+  int n = xjd1Strlen30(zName);
+  int i;
+  for(i=0; i<sizeof(aPragma)/sizeof(aPragma[0]); i++){
+    if( sqlite3_strnicmp(aPragma[i].zName, zName, n)==0
+     && aPragma[i].zName[n]==0
+    ){
+      return &aPragma[i];
+    }
+  }
+  return 0;
+}
+
+/*
+** Return the current value of an integer setting of pConn.
+*/
+static int pragmaGetInt(xjd1 *pConn, int iSetting){
+  switch( iSetting ){
+    case PRAG_ASYNC_BATCH:   return pConn->sAsync.mxDoc;
+    case PRAG_ASYNC_WINDOW:  return pConn->sAsync.msWindow;
+    case PRAG_STMT_CACHE:    return pConn->mxCache;
+    case PRAG_WRITE_BUFFER:  return pConn->mxWriteBuf;
+  }
+  return 0;
+}
+
+/*
+** Change an integer setting of pConn.  Each setting is changed the same
+** way xjd1_config() changes it.
+*/
+static int pragmaSetInt(xjd1 *pConn, int iSetting, int v){
+  int rc = XJD1_OK;
+  switch( iSetting ){
+    case PRAG_ASYNC_BATCH: {
+      rc = xjd1_config(pConn, XJD1_CONFIG_ASYNC, v, -1);
+      break;
+    }
+    case PRAG_ASYNC_WINDOW: {
+      rc = xjd1_config(pConn, XJD1_CONFIG_ASYNC, -1, v);
+      break;
+    }
+    case PRAG_STMT_CACHE: {
+      rc = xjd1_config(pConn, XJD1_CONFIG_STMTCACHE, v);
+      break;
+    }
+    case PRAG_WRITE_BUFFER: {
+      rc = xjd1_config(pConn, XJD1_CONFIG_WRITEBUF, v);
+      break;
+    }
+  }
+  return rc;
+}
+
+/*
+** Run "PRAGMA zName" or "PRAGMA zName=zArg" against the storage engine.
+** If pRes is not NULL, store the first column of the first row the
+** storage engine returns in pRes and return XJD1_ROW, or return XJD1_OK
+** if there is no row.
+*/
+static int pragmaSqlite(
+  xjd1 *pConn,                   /* The connection */
+  const char *zName,             /* Name of the pragma */
+  const char *zArg,              /* New value, already quoted, or NULL */
+  JsonNode *pRes                 /* OUT: Current value, or NULL */
+){
+  sqlite3_stmt *pSql = 0;
+  char *zSql;
+  int rc = XJD1_OK;
+
+  if( zArg ){
+    zSql = sqlite3_mprintf("PRAGMA \"%w\"=%s", zName, zArg);
+  }else{
+    zSql = sqlite3_mprintf("PRAGMA \"%w\"", zName);
+  }
+  if( zSql==0 ){
+    xjd1Error(pConn, XJD1_NOMEM, 0);
+    return XJD1_NOMEM;
+  }
+  sqlite3_prepare_v2(pConn->db, zSql, -1, &pSql, 0);
+  sqlite3_free(zSql);
+  if( pSql==0 ){
+    xjd1Error(pConn, XJD1_ERROR, "%s", sqlite3_errmsg(pConn->db));
+    return XJD1_ERROR;
+  }
+  if( sqlite3_step(pSql)==SQLITE_ROW && pRes ){
+    if( sqlite3_column_type(pSql, 0)==SQLITE_INTEGER ){
+      pRes->eJType = XJD1_INT;
+      pRes->u.i = sqlite3_column_int64(pSql, 0);
+    }else{
+      rc = xjd1JsonSetString(pRes,
+                 (const char*)sqlite3_column_text(pSql, 0),
+                 sqlite3_column_bytes(pSql, 0));
+    }
+    if( rc==XJD1_OK ) rc = XJD1_ROW;
+  }
+  while( sqlite3_step(pSql)==SQLITE_ROW ){}
+  if( sqlite3_finalize(pSql)!=SQLITE_OK ){
+    xjd1Error(pConn, XJD1_ERROR, "%s", sqlite3_errmsg(pConn->db));
+    rc = XJD1_ERROR;
+  }
+  return rc;
+}
+
+/*
+** Evaluate a pragma.  Return XJD1_ROW, with the value of the pragma in
+** pStmt->pResult, if the pragma has a value.  An unknown pragma is an
+** error.
 */
 int xjd1PragmaStep(xjd1_stmt *pStmt){
   Command *pCmd = pStmt->pCmd;
+  xjd1 *pConn = pStmt->pConn;
+  const char *zName;
+  const PragmaDef *pDef;
+  JsonNode *pVal;
+  i64 v;
   int rc = XJD1_OK;
+
   assert( pCmd!=0 );
   assert( pCmd->eCmdType==TK_PRAGMA );
+  zName = pCmd->u.prag.zName;
+  pDef = pragmaFind(zName);
+  if( pDef==0 ){
+    xjd1Error(pConn, XJD1_ERROR, "unknown pragma: %s", zName);
+    return XJD1_ERROR;
+  }
+
+  /* Query forms */
+  if( pCmd->u.prag.pValue==0 ){
+    pStmt->pResult = xjd1JsonNew(0);
+    if( pStmt->pResult==0 ){
+      xjd1Error(pConn, XJD1_NOMEM, 0);
+      return XJD1_NOMEM;
+    }
+    if( pDef->eKind==PRAGMA_INT ){
+      pStmt->pResult->eJType = XJD1_INT;
+      pStmt->pResult->u.i = pragmaGetInt(pConn, pDef->iSetting);
+      return XJD1_ROW;
+    }
+    return pragmaSqlite(pConn, pDef->zName, 0, pStmt->pResult);
+  }
+
+  /* Set forms */
+  pVal = xjd1ExprEval(pCmd->u.prag.pValue);
+  if( pDef->eKind==PRAGMA_SQLITE && pVal && pVal->eJType==XJD1_STRING ){
+    char *zArg = sqlite3_mprintf("%.*Q", xjd1JsonStrLen(pVal),
+                                 xjd1JsonStrText(pVal));
+    if( zArg==0 ){
+      xjd1Error(pConn, XJD1_NOMEM, 0);
+      rc = XJD1_NOMEM;
+    }else{
+      rc = pragmaSqlite(pConn, pDef->zName, zArg, 0);
+      sqlite3_free(zArg);
+    }
+  }else if( xjd1JsonToInt(pVal, &v) ){
+    xjd1Error(pConn, XJD1_ERROR, "bad value for pragma %s", pDef->zName);
+    rc = XJD1_ERROR;
+  }else if( pDef->eKind==PRAGMA_SQLITE ){
+    char zArg[XJD1_REAL_TEXT];
+    zArg[xjd1IntToText(v, zArg)] = 0;
+    rc = pragmaSqlite(pConn, pDef->zName, zArg, 0);
+  }else if( v<0 || v>0x7fffffff ){
+    xjd1Error(pConn, XJD1_ERROR, "bad value for pragma %s", pDef->zName);
+    rc = XJD1_ERROR;
+  }else{
+    rc = pragmaSetInt(pConn, pDef->iSetting, (int)v);
+  }
+  xjd1JsonFree(pVal);
   return rc;
 }
@@ -181,10 +181,45 @@ static void restoreResultList(ResultList *pList){
 }
 
 
-static void clearResultList(ResultList *pList){
+/*
+** Empty a ResultList so that it can be filled again.  The memory pool
+** is kept in ResultList.pSpare so that the next resultListPool() call
+** can reuse its chunks instead of allocating fresh ones.
+*/
+static void resetResultList(ResultList *pList){
+  Pool *pSpare = pList->pSpare;
   while( pList->pItem ) popResultList(pList);
-  xjd1PoolDelete(pList->pPool);
+  if( pList->pSaved ) freeResultListItem(pList, pList->pSaved);
+  if( pList->pPool ){
+    xjd1PoolDelete(pSpare);
+    xjd1PoolReset(pList->pPool);
+    pSpare = pList->pPool;
+  }
   memset(pList, 0, sizeof(ResultList));
+  pList->pSpare = pSpare;
+}
+
+/*
+** Empty a ResultList and free all of its memory.
+*/
+static void clearResultList(ResultList *pList){
+  resetResultList(pList);
+  xjd1PoolDelete(pList->pSpare);
+  pList->pSpare = 0;
+}
+
+/*
+** Return the memory pool to use for a ResultList that is about to be
+** filled.  Return NULL if a new pool cannot be allocated.
+*/
+static Pool *resultListPool(ResultList *pList){
+  if( pList->pSpare ){
+    pList->pPool = pList->pSpare;
+    pList->pSpare = 0;
+  }else{
+    pList->pPool = xjd1PoolNew();
+  }
+  return pList->pPool;
 }
 
 /*
@@ -242,19 +277,19 @@ int xjd1QueryRewind(Query *p){
   if( p==0 ) return XJD1_OK;
   if( p->eQType==TK_SELECT ){
     xjd1DataSrcRewind(p->u.simple.pFrom);
-    clearResultList(&p->u.simple.grouped);
-    clearResultList(&p->u.simple.distincted);
+    resetResultList(&p->u.simple.grouped);
+    resetResultList(&p->u.simple.distincted);
     xjd1AggregateClear(p);
   }else{
     xjd1QueryRewind(p->u.compound.pLeft);
     xjd1QueryRewind(p->u.compound.pRight);
     p->u.compound.doneLeft = 0;
-    clearResultList(&p->u.compound.left);
-    clearResultList(&p->u.compound.right);
+    resetResultList(&p->u.compound.left);
+    resetResultList(&p->u.compound.right);
     xjd1JsonFree(p->u.compound.pOut);
     p->u.compound.pOut = 0;
   }
-  clearResultList(&p->ordered);
+  resetResultList(&p->ordered);
   p->eDocFrom = XJD1_FROM_DATASRC;
   p->bLimitValid = 0;
   return XJD1_OK;
@@ -301,7 +336,7 @@ static int selectStepGrouped(Query *p){
         int saved = 0;
         Pool *pPool;
 
-        pPool = p->u.simple.grouped.pPool = xjd1PoolNew();
+        pPool = resultListPool(&p->u.simple.grouped);
         if( !pPool ) return XJD1_NOMEM;
 
         p->u.simple.grouped.nKey = nSrc = xjd1DataSrcCount(p->u.simple.pFrom);
@@ -361,7 +396,7 @@ static int selectStepGrouped(Query *p){
           Pool *pPool;
   
           /* Allocate the memory pool for this ResultList. And apKey. */
-          pPool = p->u.simple.grouped.pPool = xjd1PoolNew();
+          pPool = resultListPool(&p->u.simple.grouped);
           p->u.simple.grouped.nKey = pGroupBy->nEItem + xjd1DataSrcCount(pFrom);
           if( !pPool ) return XJD1_NOMEM;
           nByte = p->u.simple.grouped.nKey * sizeof(JsonNode *);
@@ -428,7 +463,7 @@ static int selectStepDistinct(Query *p){
       int nKey;
 
       nKey = 1 + xjd1DataSrcCount(p->u.simple.pFrom);
-      pPool = p->u.simple.distincted.pPool = xjd1PoolNew();
+      pPool = resultListPool(&p->u.simple.distincted);
       if( !pPool ) return XJD1_NOMEM;
       p->u.simple.distincted.nKey = nKey;
       apKey = xjd1PoolMallocZero(pPool, nKey * sizeof(JsonNode *));
@@ -465,7 +500,7 @@ static int cacheQuery(ResultList *pList, Query *p){
   int rc;
 
   pList->nKey = 1;
-  pPool = pList->pPool = xjd1PoolNew();
+  pPool = resultListPool(pList);
   if( !pPool ) return XJD1_NOMEM;
 
   while( XJD1_ROW==(rc = selectStepCompounded(p) ) ){
@@ -598,7 +633,7 @@ static int selectStepOrdered(Query *p){
       JsonNode **apKey;
 
       p->ordered.nKey = nKey;
-      pPool = p->ordered.pPool = xjd1PoolNew();
+      pPool = resultListPool(&p->ordered);
       if( !pPool ) return XJD1_NOMEM;
       apKey = xjd1PoolMallocZero(pPool, nKey * sizeof(JsonNode *));
       if( !apKey ) return XJD1_NOMEM;
@@ -742,6 +777,27 @@ JsonNode *xjd1QueryDoc(Query *p, int iDoc){
   return pOut;
 }
 
+/*
+** If the current result of query p is a collection document exactly as
+** it was read from storage, set *pzRaw and *pnRaw to the stored text and
+** return true.  The caller can then copy the text rather than rendering
+** the parsed document.  Return false otherwise.
+*/
+int xjd1QueryRawDoc(Query *p, const char **pzRaw, int *pnRaw){
+  Expr *pRes;
+  int iDoc = 1;
+  if( p==0 || p->eQType!=TK_SELECT || p->eDocFrom!=XJD1_FROM_DATASRC ){
+    return 0;
+  }
+  pRes = p->u.simple.pRes;
+  if( pRes ){
+    if( pRes->eType!=TK_ID || pRes->u.id.pQuery!=p || pRes->u.id.iDatasrc<1 ){
+      return 0;
+    }
+    iDoc = pRes->u.id.iDatasrc;
+  }
+  return xjd1DataSrcRaw(p->u.simple.pFrom, iDoc, pzRaw, pnRaw);
+}
 
 /*
 ** The destructor for a Query object.
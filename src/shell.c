@@ -113,6 +113,10 @@ struct Shell {
   int nCase;           /* Number of --testcase commands seen */
   int nTest;           /* Number of tests performed */
   int nErr;            /* Number of test errors */
+  int nBind;           /* Number of entries in azBind[] */
+  char *azBind[40];    /* Parameter names and JSON values from .bind */
+  int nHitBase;        /* Statement cache hits when the testcase began */
+  int nMissBase;       /* Statement cache misses when the testcase began */
 };
 
 /*
@@ -122,6 +126,10 @@ struct Shell {
 #define SHELL_CMD_TRACE        0x00002
 #define SHELL_ECHO             0x00004
 #define SHELL_TEST_MODE        0x00008
+#define SHELL_TEST_BATCH       0x00010
+#define SHELL_TEST_VALUE       0x00020
+#define SHELL_TEST_DOC         0x00040
+#define SHELL_WAL              0x00080
 static const struct {
   const char *zName;
   int iValue;
@@ -130,6 +138,10 @@ static const struct {
   {  "cmd-trace",      SHELL_CMD_TRACE    },
   {  "echo",           SHELL_ECHO         },
   {  "test-mode",      SHELL_TEST_MODE    },
+  {  "test-batch",     SHELL_TEST_BATCH   },
+  {  "test-value",     SHELL_TEST_VALUE   },
+  {  "test-doc",       SHELL_TEST_DOC     },
+  {  "wal",            SHELL_WAL          },
 };
 
 /*
@@ -194,6 +206,11 @@ static int shellTestcase(Shell *p, int argc, char **argv){
     xjd1StringTruncate(&p->testOut);
     p->testErrcode = XJD1_OK;
     p->shellFlags |= SHELL_TEST_MODE;
+    p->nHitBase = p->nMissBase = 0;
+    if( p->pDb ){
+      xjd1_config(p->pDb, XJD1_CONFIG_STMTCACHE_STAT,
+                  &p->nHitBase, &p->nMissBase);
+    }
   }
   return 0;
 }
@@ -347,12 +364,25 @@ static int shellJson(Shell *p, int argc, char **argv){
 
 /*
 ** Command:  .open FILENAME
+**
+** If the "wal" flag is set, the database is opened in a context
+** configured with XJD1_CONTEXT_WAL.
 */
 static int shellOpenDB(Shell *p, int argc, char **argv){
   if( argc>=2 ){
+    xjd1_context *pContext = 0;
     int rc;
-    if( p->pDb ) xjd1_close(p->pDb);
-    rc = xjd1_open(0, argv[1], &p->pDb);
+    if( p->pDb && xjd1_close(p->pDb)!=XJD1_OK ){
+      fprintf(stderr, "%s:%d: queued documents lost on close\n",
+              p->zFile, p->nLine);
+      p->nErr++;
+    }
+    if( p->shellFlags & SHELL_WAL ){
+      xjd1_context_new(&pContext);
+      if( pContext ) xjd1_context_config(pContext, XJD1_CONTEXT_WAL, 1);
+    }
+    rc = xjd1_open(pContext, argv[1], &p->pDb);
+    xjd1_context_delete(pContext);
     if( rc!=XJD1_OK ){
       fprintf(stderr, "%s:%d: cannot open \"%s\"\n",
               p->zFile, p->nLine, argv[1]);
@@ -367,7 +397,11 @@ static int shellOpenDB(Shell *p, int argc, char **argv){
 */
 static int shellNewDB(Shell *p, int argc, char **argv){
   if( argc>=2 ){
-    if( p->pDb ) xjd1_close(p->pDb);
+    if( p->pDb && xjd1_close(p->pDb)!=XJD1_OK ){
+      fprintf(stderr, "%s:%d: queued documents lost on close\n",
+              p->zFile, p->nLine);
+      p->nErr++;
+    }
     p->pDb = 0;
     unlink(argv[1]);
     shellOpenDB(p, argc, argv);
@@ -421,6 +455,171 @@ static int shellPuts(Shell *p, int argc, char **argv){
   return 0;
 }
 
+/*
+** Command:  .bind ?NAME JSON?
+**
+** Bind JSON to the parameter NAME, which is either ":name" or a parameter
+** number, of every statement that follows.  With no arguments, forget
+** all bindings.
+*/
+static int shellBind(Shell *p, int argc, char **argv){
+  char *zName, *zJson;
+  int n;
+  if( argc<2 ){
+    while( p->nBind>0 ) free(p->azBind[--p->nBind]);
+    return 0;
+  }
+  for(n=0; argv[1][n] && !shellIsSpace(argv[1][n]); n++){}
+  if( argv[1][n]==0 || p->nBind+2>ArraySize(p->azBind) ){
+    fprintf(stderr, "%s:%d: usage: .bind NAME JSON\n", p->zFile, p->nLine);
+    return 0;
+  }
+  zName = malloc( n+1 );
+  zJson = malloc( strlen(&argv[1][n])+1 );
+  if( zName==0 || zJson==0 ){
+    free(zName);
+    free(zJson);
+    return 0;
+  }
+  memcpy(zName, argv[1], n);
+  zName[n] = 0;
+  strcpy(zJson, &argv[1][n+1]);
+  p->azBind[p->nBind++] = zName;
+  p->azBind[p->nBind++] = zJson;
+  return 0;
+}
+
+/* Forward declaration */
+static void appendTestOut(Shell*, const char*, int);
+
+/*
+** Command:  .stmtcache
+**
+** Show the number of statements taken from the statement cache and the
+** number that were not found there, since the current testcase began.
+*/
+static int shellStmtCache(Shell *p, int argc, char **argv){
+  int nHit = 0, nMiss = 0;
+  char zBuf[50];
+  if( p->pDb==0 ) return 0;
+  xjd1_config(p->pDb, XJD1_CONFIG_STMTCACHE_STAT, &nHit, &nMiss);
+  sprintf(zBuf, "%d %d", nHit - p->nHitBase, nMiss - p->nMissBase);
+  if( p->shellFlags & SHELL_TEST_MODE ){
+    appendTestOut(p, zBuf, -1);
+  }else{
+    printf("%s\n", zBuf);
+  }
+  return 0;
+}
+
+/*
+** Bytes read at a time by .load in test mode.  Small chunks make the
+** test scripts cover documents that span chunks.
+*/
+#define SHELL_TEST_LOAD_CHUNK 7
+
+/*
+** State of a .load command, passed to shellLoadRead().
+*/
+typedef struct ShellLoad ShellLoad;
+struct ShellLoad {
+  FILE *in;             /* File being loaded */
+  int mxChunk;          /* Most bytes to read at a time, or 0 for no limit */
+};
+
+/* Read the next chunk of a .load file, for xjd1_load_stream() */
+static int shellLoadRead(void *pArg, char *zBuf, int nBuf){
+  ShellLoad *pLoad = (ShellLoad*)pArg;
+  size_t n;
+  if( pLoad->mxChunk>0 && nBuf>pLoad->mxChunk ) nBuf = pLoad->mxChunk;
+  n = fread(zBuf, 1, nBuf, pLoad->in);
+  if( n==0 && ferror(pLoad->in) ) return -1;
+  return (int)n;
+}
+
+/*
+** Command:  .load COLLECTION FILENAME
+**
+** Load the documents in FILENAME into COLLECTION using xjd1_load_stream().
+** The file holds either a JSON array of documents or one document per
+** line.  A relative FILENAME is relative to the directory of the script.
+*/
+static int shellLoad(Shell *p, int argc, char **argv){
+  String fileName;
+  char *zColl;
+  ShellLoad sLoad;
+  FILE *in;
+  int nDoc = 0;
+  int n, rc;
+  if( argc<2 || p->pDb==0 ) return 0;
+  for(n=0; argv[1][n] && !shellIsSpace(argv[1][n]); n++){}
+  if( argv[1][n]==0 ){
+    fprintf(stderr, "%s:%d: usage: .load COLLECTION FILENAME\n",
+            p->zFile, p->nLine);
+    return 0;
+  }
+  argv[1][n] = 0;
+  zColl = argv[1];
+  xjd1StringInit(&fileName, 0, 0);
+  if( argv[1][n+1]=='/' || strcmp(p->zFile,"-")==0 ){
+    xjd1StringAppend(&fileName, &argv[1][n+1], -1);
+  }else{
+    int i, j;
+    for(i=j=0; p->zFile[i]; i++){ if( p->zFile[i]=='/' ) j = i; }
+    if( j ){
+      xjd1StringAppendF(&fileName, "%.*s/%s", j, p->zFile, &argv[1][n+1]);
+    }else{
+      xjd1StringAppend(&fileName, &argv[1][n+1], -1);
+    }
+  }
+  in = fopen(xjd1StringText(&fileName), "rb");
+  if( in==0 ){
+    fprintf(stderr, "%s:%d: cannot open \"%s\"\n",
+            p->zFile, p->nLine, xjd1StringText(&fileName));
+    p->nErr++;
+    xjd1StringClear(&fileName);
+    return 0;
+  }
+  sLoad.in = in;
+  sLoad.mxChunk = 0;
+  if( p->shellFlags & SHELL_TEST_MODE ) sLoad.mxChunk = SHELL_TEST_LOAD_CHUNK;
+  rc = xjd1_load_stream(p->pDb, zColl, shellLoadRead, &sLoad, &nDoc);
+  if( rc!=XJD1_OK ){
+    if( p->shellFlags & SHELL_TEST_MODE ){
+      appendTestOut(p, xjd1_errcode_name(p->pDb), -1);
+      appendTestOut(p, xjd1_errmsg(p->pDb), -1);
+      p->testErrcode = rc;
+    }else{
+      fprintf(stderr, "%s:%d: ERROR: %s\n",
+              p->zFile, p->nLine, xjd1_errmsg(p->pDb));
+      p->nErr++;
+    }
+  }else if( (p->shellFlags & SHELL_TEST_MODE)==0 ){
+    printf("%d documents loaded\n", nDoc);
+  }
+  fclose(in);
+  xjd1StringClear(&fileName);
+  return 0;
+}
+
+/*
+** Apply the bindings from .bind to a new statement.  Bindings for
+** parameters that the statement does not have are ignored.
+*/
+static void shellApplyBindings(Shell *p, xjd1_stmt *pStmt){
+  int i, iParam;
+  for(i=0; i<p->nBind; i+=2){
+    if( p->azBind[i][0]>='0' && p->azBind[i][0]<='9' ){
+      iParam = atoi(p->azBind[i]);
+    }else{
+      iParam = xjd1_stmt_bind_index(pStmt, p->azBind[i]);
+    }
+    if( iParam>0 && iParam<=xjd1_stmt_bind_count(pStmt) ){
+      xjd1_stmt_bind_json(pStmt, iParam, p->azBind[i+1], -1);
+    }
+  }
+}
+
 static void checkForTestError(Shell *p){
   if( (p->shellFlags & SHELL_TEST_MODE) && p->testErrcode ){
     fprintf(stderr, "%s:%d: ERROR: %s\n", p->zFile, p->nLine, p->testOut.zBuf);
@@ -459,6 +658,9 @@ static int processMetaCommand(Shell *p){ char *z;
     { "set",        shellSet,         ".set FLAG"           },
     { "clear",      shellClear,       ".clear FLAG"         },
     { "breakpoint", shellBreakpoint,  ".breakpoint"         },
+    { "bind",       shellBind,        ".bind ?NAME JSON?"   },
+    { "load",       shellLoad,        ".load COLLECTION FILENAME" },
+    { "stmtcache",  shellStmtCache,   ".stmtcache"          },
   };
 
   /* Remove trailing whitespace from the command */
@@ -529,6 +731,154 @@ static void appendTestOut(Shell *p, const char *z, int n){
   xjd1StringAppend(&p->testOut, z, n);
 }
 
+/*
+** Result sink used in test mode.  Append each row to testOut.
+*/
+static int testOutSink(void *pArg, const char *z, int n){
+  appendTestOut((Shell*)pArg, z, n);
+  return 0;
+}
+
+/*
+** Number of result rows rendered per xjd1_stmt_batch() call when results
+** are written to standard output, and in test mode with "test-batch" set.
+** The second is small so that tests cover queries that take several
+** batches.
+*/
+#define SHELL_BATCH 64
+#define SHELL_TEST_BATCH_ROWS 3
+
+/*
+** Append to pOut a description of value pVal built only from the
+** xjd1_value interfaces, so that tests can check those interfaces.
+** Each part of the value is shown with its type:
+**
+**     int:V            An integer, from xjd1_value_int()
+**     real:V/I         A real, from xjd1_value_real() and xjd1_value_int()
+**     text:N:TEXT      A string of N bytes, from xjd1_value_text()
+**     [N:E,...]        An array of N elements, from xjd1_value_element()
+**     {N:L=V,...}      A structure of N members.  Each value is found by
+**                      passing label L to xjd1_value_lookup()
+**
+** Other values are shown as true, false or null.
+*/
+static void testDescribeValue(String *pOut, xjd1_value *pVal){
+  int i, n;
+  const char *z;
+  switch( xjd1_value_type(pVal) ){
+    case XJD1_TRUE:    xjd1StringAppend(pOut, "true", 4);   break;
+    case XJD1_FALSE:   xjd1StringAppend(pOut, "false", 5);  break;
+    case XJD1_NULL:    xjd1StringAppend(pOut, "null", 4);   break;
+    case XJD1_INT: {
+      xjd1StringAppendF(pOut, "int:%lld", xjd1_value_int(pVal));
+      break;
+    }
+    case XJD1_REAL: {
+      xjd1StringAppendF(pOut, "real:%.17g/%lld",
+                        xjd1_value_real(pVal), xjd1_value_int(pVal));
+      break;
+    }
+    case XJD1_STRING: {
+      z = xjd1_value_text(pVal, &n);
+      xjd1StringAppendF(pOut, "text:%d:%.*s", n, n, z);
+      break;
+    }
+    case XJD1_ARRAY: {
+      n = xjd1_value_count(pVal);
+      xjd1StringAppendF(pOut, "[%d:", n);
+      for(i=0; i<n; i++){
+        if( i ) xjd1StringAppend(pOut, ",", 1);
+        testDescribeValue(pOut, xjd1_value_element(pVal, i));
+      }
+      xjd1StringAppend(pOut, "]", 1);
+      break;
+    }
+    case XJD1_STRUCT: {
+      n = xjd1_value_count(pVal);
+      xjd1StringAppendF(pOut, "{%d:", n);
+      for(i=0; i<n; i++){
+        z = xjd1_value_label(pVal, i);
+        xjd1StringAppendF(pOut, "%s%s=", i ? "," : "", z);
+        testDescribeValue(pOut, xjd1_value_lookup(pVal, z));
+      }
+      xjd1StringAppend(pOut, "}", 1);
+      break;
+    }
+  }
+}
+
+/*
+** Run statement pStmt to completion in test mode and append each result
+** row to testOut.  Rows are collected with a result sink, or with
+** xjd1_stmt_value() if the "test-value" flag is set.  If "test-doc" is
+** set, each row is read with xjd1_stmt_doc() and described by
+** testDescribeValue().
+**
+** If the "test-batch" flag is set, xjd1_stmt_batch() and xjd1_stmt_step()
+** are called in turn.  Once one of them reports the end of a statement
+** that returned rows, the other is called too.  It must report the end
+** as well rather than start the query over.
+**
+** Return the result of the step that first reported the end.
+*/
+static int testRunStatement(Shell *p, xjd1_stmt *pStmt){
+  int rc;
+  if( p->shellFlags & SHELL_TEST_BATCH ){
+    const char *zRows;
+    int aiRow[SHELL_TEST_BATCH_ROWS+1];
+    int nRow, i;
+    int bStep = 0;
+    int bRow = 0;
+    int nEnd = 0;
+    int rcEnd = XJD1_DONE;
+    while( nEnd<2 ){
+      if( bStep ){
+        rc = xjd1_stmt_step(pStmt);
+        if( rc==XJD1_ROW ){
+          xjd1_stmt_value(pStmt, &zRows);
+          if( zRows ) appendTestOut(p, zRows, -1);
+        }
+      }else{
+        rc = xjd1_stmt_batch(pStmt, SHELL_TEST_BATCH_ROWS, &zRows,
+                             aiRow, &nRow);
+        for(i=0; rc==XJD1_ROW && i<nRow; i++){
+          appendTestOut(p, &zRows[aiRow[i]], aiRow[i+1]-aiRow[i]-1);
+        }
+      }
+      if( rc==XJD1_ROW ){
+        nEnd = 0;
+        bRow = 1;
+      }else if( nEnd++==0 ){
+        rcEnd = rc;
+        if( !bRow ) break;
+      }
+      bStep = !bStep;
+    }
+    rc = rcEnd;
+  }else if( p->shellFlags & SHELL_TEST_DOC ){
+    xjd1_value *pVal;
+    String desc;
+    xjd1StringInit(&desc, 0, 0);
+    while( (rc = xjd1_stmt_step(pStmt))==XJD1_ROW ){
+      xjd1_stmt_doc(pStmt, &pVal);
+      xjd1StringTruncate(&desc);
+      testDescribeValue(&desc, pVal);
+      appendTestOut(p, xjd1StringText(&desc), xjd1StringLen(&desc));
+    }
+    xjd1StringClear(&desc);
+  }else if( p->shellFlags & SHELL_TEST_VALUE ){
+    const char *zValue;
+    while( (rc = xjd1_stmt_step(pStmt))==XJD1_ROW ){
+      xjd1_stmt_value(pStmt, &zValue);
+      if( zValue ) appendTestOut(p, zValue, -1);
+    }
+  }else{
+    xjd1_stmt_config(pStmt, XJD1_STMT_SINK, testOutSink, p);
+    while( (rc = xjd1_stmt_step(pStmt))==XJD1_ROW ){}
+  }
+  return rc;
+}
+
 /*
 ** Run a single statment.
 */
@@ -543,27 +893,32 @@ static void processOneStatement(Shell *p, const char *zCmd){
               (p->shellFlags & SHELL_PARSER_TRACE)!=0);
   rc = xjd1_stmt_new(p->pDb, zCmd, &pStmt, &N);
   if( rc==XJD1_OK ){
+    shellApplyBindings(p, pStmt);
     if( p->shellFlags & SHELL_CMD_TRACE ){
       char *zTrace = xjd1_stmt_debug_listing(pStmt);
       if( zTrace ) printf("%s", zTrace);
       free(zTrace);
     }
-    do{
-      rc = xjd1_stmt_step(pStmt);
-      if( rc==XJD1_ROW ){
-        const char *zValue;
-        xjd1_stmt_value(pStmt, &zValue);
-        if( (p->shellFlags & SHELL_TEST_MODE)==0 ){
-          if( once==0 && (p->shellFlags & SHELL_ECHO)!=0 ){
-            printf("--------- query results ---------\n");
-            once = 1;
-          }
-          printf("%s\n", zValue);
-        }else{
-          appendTestOut(p, zValue, -1);
+    if( p->shellFlags & SHELL_TEST_MODE ){
+      rc = testRunStatement(p, pStmt);
+      if( rc!=XJD1_OK && rc!=XJD1_DONE ){
+        appendTestOut(p, xjd1_errcode_name(p->pDb), -1);
+        appendTestOut(p, xjd1_errmsg(p->pDb), -1);
+        p->testErrcode = rc;
+      }
+    }else{
+      const char *zRows;
+      int aiRow[SHELL_BATCH+1];
+      int nRow;
+      while( xjd1_stmt_batch(pStmt, SHELL_BATCH, &zRows, aiRow, &nRow)
+                 ==XJD1_ROW ){
+        if( once==0 && (p->shellFlags & SHELL_ECHO)!=0 ){
+          printf("--------- query results ---------\n");
+          once = 1;
         }
+        fwrite(zRows, 1, aiRow[nRow], stdout);
       }
-    }while( rc==XJD1_ROW );
+    }
     xjd1_stmt_delete(pStmt);
   }else{
     if( p->shellFlags & SHELL_TEST_MODE ){
@@ -700,5 +1055,6 @@ int main(int argc, char **argv){
   if( s.pDb ) xjd1_close(s.pDb);
   xjd1StringClear(&s.inBuf);
   xjd1StringClear(&s.testOut);
+  shellBind(&s, 1, 0);
   return 0;
 }
@@ -18,6 +18,110 @@
 */
 #include "xjd1Int.h"
 
+static void stmtFree(xjd1_stmt*);
+
+/*
+** Add statement p to the front of the list *ppList.
+*/
+static void stmtLink(xjd1_stmt *p, xjd1_stmt **ppList){
+  p->pPrev = 0;
+  p->pNext = *ppList;
+  if( p->pNext ) p->pNext->pPrev = p;
+  *ppList = p;
+}
+
+/*
+** Remove statement p from the list *ppList.
+*/
+static void stmtUnlink(xjd1_stmt *p, xjd1_stmt **ppList){
+  if( p->pPrev ){
+    p->pPrev->pNext = p->pNext;
+  }else{
+    assert( *ppList==p );
+    *ppList = p->pNext;
+  }
+  if( p->pNext ){
+    p->pNext->pPrev = p->pPrev;
+  }
+  p->pNext = p->pPrev = 0;
+}
+
+/*
+** Look in the statement cache of pConn for a statement prepared from the
+** text at the beginning of zStmt.  If one is found, remove it from the
+** cache and return it.  Otherwise return NULL.
+**
+** No storage is read here.  The storage engine statements that a cached
+** statement holds are prepared again by the storage engine if the schema
+** changes.  Statements that found a collection missing hold no storage
+** engine statement for it, so they are never cached.
+*/
+static xjd1_stmt *stmtCacheFind(xjd1 *pConn, const char *zStmt){
+  xjd1_stmt *p;
+
+  if( pConn->mxCache<=0 || pConn->parserTrace ) return 0;
+  for(p=pConn->pCache; p; p=p->pNext){
+    if( strncmp(p->zCode, zStmt, p->nCode)==0
+     && (zStmt[p->nCode]==0 || p->zCode[p->nCode-1]==';')
+    ){
+      /* The text of a statement either ends with its ';' or is all of
+      ** zStmt.  In either case the cached statement is the same one. */
+      stmtUnlink(p, &pConn->pCache);
+      pConn->nCache--;
+      p->isCached = 0;
+      stmtLink(p, &pConn->pStmt);
+      pConn->nCacheHit++;
+      return p;
+    }
+  }
+  pConn->nCacheMiss++;
+  return 0;
+}
+
+/*
+** Try to put statement p, which the application is finished with, into
+** the statement cache instead of deleting it.  Return true if the
+** statement was cached.  If the cache is full, the least recently used
+** statement in it is deleted.
+*/
+static int stmtCacheSave(xjd1_stmt *p){
+  xjd1 *pConn = p->pConn;
+  xjd1_stmt *pLast;
+
+  if( p->nCode==0 || p->isCached || pConn->isDying ) return 0;
+  if( pConn->mxCache<=0 || p->noCache ) return 0;
+
+  xjd1_stmt_rewind(p);
+  xjd1_stmt_clear_bindings(p);
+  p->xSink = 0;
+  p->pSinkArg = 0;
+  p->isDying = 0;
+  stmtUnlink(p, &pConn->pStmt);
+  stmtLink(p, &pConn->pCache);
+  p->isCached = 1;
+  pConn->nCache++;
+
+  if( pConn->nCache>pConn->mxCache ){
+    for(pLast=pConn->pCache; pLast->pNext; pLast=pLast->pNext){}
+    stmtUnlink(pLast, &pConn->pCache);
+    pConn->nCache--;
+    stmtFree(pLast);
+  }
+  return 1;
+}
+
+/*
+** Delete every statement in the statement cache of pConn.
+*/
+PRIVATE void xjd1StmtCacheFlush(xjd1 *pConn){
+  while( pConn->pCache ){
+    xjd1_stmt *p = pConn->pCache;
+    stmtUnlink(p, &pConn->pCache);
+    stmtFree(p);
+  }
+  pConn->nCache = 0;
+}
+
 /*
 ** Create a new prepared statement for database connection pConn.  The
 ** program code to be parsed is zStmt.  Return the new statement in *ppNew.
@@ -30,13 +134,21 @@ int xjd1_stmt_new(xjd1 *pConn, const char *zStmt, xjd1_stmt **ppNew, int *pN){
   int rc;
 
   if( pN==0 ) pN = &dummy;
+  *ppNew = 0;
+  rc = xjd1AsyncPoll(pConn);
+  if( rc ) return rc;
+  *ppNew = p = stmtCacheFind(pConn, zStmt);
+  if( p ){
+    *pN = p->nCode;
+    return XJD1_OK;
+  }
   *pN = strlen(zStmt);
   *ppNew = p = xjd1_malloc( sizeof(*p) );
   if( p==0 ) return XJD1_NOMEM;
   memset(p, 0, sizeof(*p));
   p->pConn = pConn;
-  p->pNext = pConn->pStmt;
-  pConn->pStmt = p;
+  stmtLink(p, &pConn->pStmt);
+  pConn->nRef++;
   p->zCode = xjd1PoolDup(&p->sPool, zStmt, -1);
   xjd1StringInit(&p->retValue, &p->sPool, 0);
   xjd1StringInit(&p->errMsg, &p->sPool, 0);
@@ -44,6 +156,15 @@ int xjd1_stmt_new(xjd1 *pConn, const char *zStmt, xjd1_stmt **ppNew, int *pN){
   rc = xjd1RunParser(pConn, p, p->zCode, pN);
   pCmd = p->pCmd;
   assert( rc==XJD1_OK || (pCmd==0 && pConn->errCode==rc) );
+  if( p->nParam>0 ){
+    p->apParam = xjd1_malloc( sizeof(JsonNode*)*p->nParam );
+    if( p->apParam==0 ){
+      pCmd = 0;
+      rc = XJD1_NOMEM;
+    }else{
+      memset(p->apParam, 0, sizeof(JsonNode*)*p->nParam);
+    }
+  }
 
   if( pCmd ){
     switch( pCmd->eCmdType ){
@@ -52,6 +173,8 @@ int xjd1_stmt_new(xjd1 *pConn, const char *zStmt, xjd1_stmt **ppNew, int *pN){
         break;
       }
       case TK_INSERT: {
+        xjd1ExprInit(pCmd->u.ins.pValue, p, 0, 0, 0);
+        xjd1ExprListInit(pCmd->u.ins.pList, p, 0, 0, 0);
         xjd1QueryInit(pCmd->u.ins.pQuery, p, 0);
         break;
       }
@@ -65,6 +188,10 @@ int xjd1_stmt_new(xjd1 *pConn, const char *zStmt, xjd1_stmt **ppNew, int *pN){
         xjd1ExprInit(pCmd->u.update.pUpsert, p, 0, 0, 0);
         break;
       }
+      case TK_PRAGMA: {
+        xjd1ExprInit(pCmd->u.prag.pValue, p, 0, 0, 0);
+        break;
+      }
     }
 
     if( p->errCode ){
@@ -78,27 +205,62 @@ int xjd1_stmt_new(xjd1 *pConn, const char *zStmt, xjd1_stmt **ppNew, int *pN){
   if( rc!=XJD1_OK ){
     xjd1_stmt_delete(p);
     *ppNew = 0;
+  }else{
+    p->nCode = *pN;
   }
   return rc;
 }
 
 /*
 ** Configure a prepared statement.
+**
+** XJD1_STMT_SINK takes a callback and a pointer that is passed to it as
+** its first argument.  Each result row is then handed to the callback as
+** it is produced, together with its length in bytes, instead of being
+** kept for xjd1_stmt_value().  The text is only valid for the duration
+** of the call.  If the callback returns non-zero, xjd1_stmt_step()
+** returns XJD1_ERROR.  A NULL callback restores the default behavior.
 */
-int xdj1_stmt_config(xjd1_stmt *pStmt, int op, ...){
-  return XJD1_UNKNOWN;
+int xjd1_stmt_config(xjd1_stmt *pStmt, int op, ...){
+  int rc = XJD1_UNKNOWN;
+  va_list ap;
+  if( pStmt==0 ) return XJD1_MISUSE;
+  va_start(ap, op);
+  switch( op ){
+    case XJD1_STMT_SINK: {
+      pStmt->xSink = va_arg(ap, int(*)(void*,const char*,int));
+      pStmt->pSinkArg = va_arg(ap, void*);
+      rc = XJD1_OK;
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+  va_end(ap);
+  return rc;
 }
 
 /*
-** Delete a prepared statement.
+** Delete a prepared statement.  If the statement can be reused, it is
+** kept in the statement cache of its connection instead.
 */
 int xjd1_stmt_delete(xjd1_stmt *pStmt){
-  Command *pCmd;
   if( pStmt==0 ) return XJD1_OK;
   pStmt->isDying = 1;
   if( pStmt->nRef>0 ) return XJD1_OK;
+  if( stmtCacheSave(pStmt) ) return XJD1_OK;
+  stmtUnlink(pStmt, &pStmt->pConn->pStmt);
+  stmtFree(pStmt);
+  return XJD1_OK;
+}
 
-  pCmd = pStmt->pCmd;
+/*
+** Free a prepared statement that is not part of any list.
+*/
+static void stmtFree(xjd1_stmt *pStmt){
+  Command *pCmd = pStmt->pCmd;
+  int i;
   if( pCmd ){
     switch( pCmd->eCmdType ){
       case TK_SELECT: {
@@ -106,6 +268,8 @@ int xjd1_stmt_delete(xjd1_stmt *pStmt){
         break;
       }
       case TK_INSERT: {
+        xjd1ExprClose(pCmd->u.ins.pValue);
+        xjd1ExprListClose(pCmd->u.ins.pList);
         xjd1QueryClose(pCmd->u.ins.pQuery);
         break;
       }
@@ -119,23 +283,127 @@ int xjd1_stmt_delete(xjd1_stmt *pStmt){
         xjd1ExprClose(pCmd->u.update.pUpsert);
         break;
       }
+      case TK_PRAGMA: {
+        xjd1ExprClose(pCmd->u.prag.pValue);
+        break;
+      }
     }
   }
 
-  if( pStmt->pPrev ){
-    pStmt->pPrev->pNext = pStmt->pNext;
-  }else{
-    assert( pStmt->pConn->pStmt==pStmt );
-    pStmt->pConn->pStmt = pStmt->pNext;
-  }
-  if( pStmt->pNext ){
-    pStmt->pNext->pPrev = pStmt->pPrev;
+  for(i=0; i<XJD1_STMT_NSQL; i++){
+    sqlite3_finalize(pStmt->apSql[i]);
   }
+  xjd1JsonFree(pStmt->pResult);
+  xjd1_stmt_clear_bindings(pStmt);
+  xjd1_free(pStmt->apParam);
   xjd1Unref(pStmt->pConn);
   xjd1PoolClear(&pStmt->sPool);
   xjd1StringClear(&pStmt->retValue);
   xjd1_free(pStmt);
-  return XJD1_OK;
+}
+
+/*
+** Return the SQLite statement held in slot iSql of pStmt, preparing it
+** from zFormat (an sqlite3_mprintf() format string) the first time the
+** slot is used.  Later calls return the same statement, already reset,
+** so that a command run many times, or rewound and run again, compiles
+** its SQL only once.  Return NULL if the SQL cannot be prepared.
+*/
+PRIVATE sqlite3_stmt *xjd1StmtSql(
+  xjd1_stmt *pStmt,              /* Statement that owns the slot */
+  int iSql,                      /* Slot number */
+  const char *zFormat,           /* Text of the SQL */
+  ...                            /* Arguments to zFormat */
+){
+  sqlite3_stmt *pSql;
+  assert( iSql>=0 && iSql<XJD1_STMT_NSQL );
+  pSql = pStmt->apSql[iSql];
+  if( pSql ){
+    sqlite3_reset(pSql);
+  }else{
+    va_list ap;
+    char *zSql;
+    va_start(ap, zFormat);
+    zSql = sqlite3_vmprintf(zFormat, ap);
+    va_end(ap);
+    if( zSql==0 ) return 0;
+    sqlite3_prepare_v2(pStmt->pConn->db, zSql, -1, &pSql, 0);
+    sqlite3_free(zSql);
+    pStmt->apSql[iSql] = pSql;
+  }
+  return pSql;
+}
+
+/*
+** Forget the current result row of a SELECT statement.
+*/
+static void stmtClearRow(xjd1_stmt *pStmt){
+  xjd1StringTruncate(&pStmt->retValue);
+  pStmt->okValue = 0;
+  pStmt->isRow = 0;
+  xjd1JsonFree(pStmt->pResult);
+  pStmt->pResult = 0;
+}
+
+/*
+** Append the text of the current result row of SELECT statement pStmt
+** to pOut.
+*/
+static void stmtRenderRow(xjd1_stmt *pStmt, String *pOut){
+  Query *pQuery = pStmt->pCmd->u.q.pQuery;
+  const char *zRaw;
+  int nRaw;
+  if( xjd1QueryRawDoc(pQuery, &zRaw, &nRaw) ){
+    /* An unchanged document.  Its stored text is its rendering. */
+    xjd1StringAppend(pOut, zRaw, nRaw);
+  }else if( pStmt->pResult ){
+    /* Already built by xjd1_stmt_doc() */
+    xjd1JsonRender(pOut, pStmt->pResult);
+  }else{
+    JsonNode *pValue = xjd1QueryDoc(pQuery, 0);
+    xjd1JsonRender(pOut, pValue);
+    xjd1JsonFree(pValue);
+  }
+}
+
+/*
+** Hand the current result row of SELECT statement pStmt to the sink
+** registered with XJD1_STMT_SINK.  Documents that are returned unchanged
+** are passed straight from storage.  Return XJD1_ROW, or XJD1_ERROR if
+** the sink reports a failure.
+*/
+static int stmtSinkRow(xjd1_stmt *pStmt){
+  const char *zRaw;
+  int nRaw;
+  int rc;
+  if( xjd1QueryRawDoc(pStmt->pCmd->u.q.pQuery, &zRaw, &nRaw) ){
+    rc = pStmt->xSink(pStmt->pSinkArg, zRaw, nRaw);
+  }else{
+    stmtRenderRow(pStmt, &pStmt->retValue);
+    rc = pStmt->xSink(pStmt->pSinkArg, pStmt->retValue.zBuf,
+                      pStmt->retValue.nUsed);
+    xjd1StringTruncate(&pStmt->retValue);
+  }
+  if( rc ){
+    xjd1Error(pStmt->pConn, XJD1_ERROR, "result sink failed");
+    return XJD1_ERROR;
+  }
+  return XJD1_ROW;
+}
+
+/*
+** Write the documents queued by ASYNC INSERT statements, unless pCmd is
+** itself an ASYNC INSERT and the queue is not yet due.  Any other
+** statement must see them.
+*/
+static int stmtFlushAsync(xjd1_stmt *pStmt){
+  Command *pCmd = pStmt->pCmd;
+  AsyncQueue *pQ = &pStmt->pConn->sAsync;
+  if( pQ->nDoc==0 && pQ->nSent==0 ) return XJD1_OK;
+  if( pCmd->eCmdType==TK_INSERT && pCmd->u.ins.isAsync ){
+    return xjd1AsyncPoll(pStmt->pConn);
+  }
+  return xjd1AsyncFlush(pStmt->pConn);
 }
 
 /*
@@ -148,11 +416,15 @@ int xjd1_stmt_step(xjd1_stmt *pStmt){
   if( pStmt==0 ) return rc;
   pCmd = pStmt->pCmd;
   if( pCmd==0 ) return rc;
+  rc = stmtFlushAsync(pStmt);
+  if( rc ) return rc;
+  rc = XJD1_DONE;
   switch( pCmd->eCmdType ){
     case TK_CREATECOLLECTION: {
       char *zSql;
       int res;
       char *zErr = 0;
+      xjd1StmtCacheFlush(pStmt->pConn);
       zSql = sqlite3_mprintf("CREATE TABLE %s \"%w\"(x)",
                  pCmd->u.crtab.ifExists ? "IF NOT EXISTS" : "",
                  pCmd->u.crtab.zName);
@@ -169,6 +441,7 @@ int xjd1_stmt_step(xjd1_stmt *pStmt){
       char *zSql;
       int res;
       char *zErr = 0;
+      xjd1StmtCacheFlush(pStmt->pConn);
       zSql = sqlite3_mprintf("DROP TABLE %s \"%w\"",
                  pCmd->u.crtab.ifExists ? "IF EXISTS" : "",
                  pCmd->u.crtab.zName);
@@ -182,45 +455,27 @@ int xjd1_stmt_step(xjd1_stmt *pStmt){
       break;
     }
     case TK_INSERT: {
-      JsonNode *pNode;
-      String json;
-      int res;
-      char *zErr;
-      char *zSql;
-      if( pCmd->u.ins.pQuery ){
-        xjd1Error(pStmt->pConn, XJD1_ERROR, 
-                 "INSERT INTO ... SELECT not yet implemented");
-        break;
-      }
-      pNode = xjd1ExprEval(pCmd->u.ins.pValue);
-      if( pNode==0 ) break;
-      xjd1StringInit(&json,0,0);
-      xjd1JsonRender(&json, pNode);
-      xjd1JsonFree(pNode);
-      zSql = sqlite3_mprintf("INSERT INTO \"%w\" VALUES('%q')",
-                  pCmd->u.ins.zName,
-                  xjd1StringText(&json));
-      xjd1StringClear(&json);
-      res = sqlite3_exec(pStmt->pConn->db, zSql, 0, 0, &zErr);
-      if( zErr ){
-        xjd1Error(pStmt->pConn, XJD1_ERROR, "%s", zErr);
-        sqlite3_free(zErr);
-        rc = XJD1_ERROR;
-      }
-      sqlite3_free(zSql);
+      rc = xjd1InsertStep(pStmt);
       break;
     }
     case TK_SELECT: {
       Query *pQuery = pCmd->u.q.pQuery;
+      stmtClearRow(pStmt);
+      if( pStmt->isEof ){
+        rc = pStmt->rcEof;
+        break;
+      }
       rc = xjd1QueryStep(pQuery);
-      xjd1StringClear(&pStmt->retValue);
-      if( rc==XJD1_ROW ){
-        JsonNode *pValue = xjd1QueryDoc(pQuery, 0);
-        xjd1JsonRender(&pStmt->retValue, pValue);
-        xjd1JsonFree(pValue);
-        pStmt->okValue = 1;
+      if( rc!=XJD1_ROW ){
+        /* Stepping the query again would start it over.  See
+        ** xjd1_stmt_batch(). */
+        pStmt->isEof = 1;
+        pStmt->rcEof = rc;
       }else{
-        pStmt->okValue = 0;
+        /* The row is rendered by xjd1_stmt_value() if it is asked for.
+        ** Callers that use xjd1_stmt_doc() never pay for rendering. */
+        pStmt->isRow = 1;
+        if( pStmt->xSink ) rc = stmtSinkRow(pStmt);
       }
       break;
     }
@@ -233,7 +488,32 @@ int xjd1_stmt_step(xjd1_stmt *pStmt){
       break;
     }
     case TK_PRAGMA: {
+      /* A pragma is run once.  If it has a value, that is its only
+      ** result row. */
+      stmtClearRow(pStmt);
+      if( pStmt->isEof ) break;
+      pStmt->isEof = 1;
       rc = xjd1PragmaStep(pStmt);
+      if( rc==XJD1_ROW ){
+        pStmt->isRow = 1;
+        xjd1JsonRender(&pStmt->retValue, pStmt->pResult);
+        if( pStmt->xSink ){
+          if( pStmt->xSink(pStmt->pSinkArg, pStmt->retValue.zBuf,
+                           pStmt->retValue.nUsed) ){
+            xjd1Error(pStmt->pConn, XJD1_ERROR, "result sink failed");
+            rc = XJD1_ERROR;
+          }
+          xjd1StringTruncate(&pStmt->retValue);
+        }else{
+          pStmt->okValue = 1;
+        }
+      }
+      break;
+    }
+    case TK_BEGIN:
+    case TK_COMMIT:
+    case TK_ROLLBACK: {
+      rc = xjd1TransStep(pStmt);
       break;
     }
   }
@@ -245,18 +525,27 @@ int xjd1_stmt_step(xjd1_stmt *pStmt){
 */
 int xjd1_stmt_rewind(xjd1_stmt *pStmt){
   Command *pCmd = pStmt->pCmd;
+  int i;
+  for(i=0; i<XJD1_STMT_NSQL; i++){
+    if( pStmt->apSql[i] ) sqlite3_reset(pStmt->apSql[i]);
+  }
   if( pCmd ){
     switch( pCmd->eCmdType ){
       case TK_SELECT: {
         xjd1QueryRewind(pCmd->u.q.pQuery);
-        xjd1StringTruncate(&pStmt->retValue);
-        pStmt->okValue = 0;
+        stmtClearRow(pStmt);
+        pStmt->isEof = 0;
         break;
       }
       case TK_INSERT: {
         xjd1QueryRewind(pCmd->u.ins.pQuery);
         break;
       }
+      case TK_PRAGMA: {
+        stmtClearRow(pStmt);
+        pStmt->isEof = 0;
+        break;
+      }
     }
   }
   return XJD1_OK;
@@ -264,14 +553,217 @@ int xjd1_stmt_rewind(xjd1_stmt *pStmt){
 
 /*
 ** Return the output value of a prepared statement resulting from
-** its most recent xjd1_stmt_step() call.
+** its most recent xjd1_stmt_step() call.  A SELECT row is rendered on
+** the first call for that row.
 */
 int xjd1_stmt_value(xjd1_stmt *pStmt, const char **pzValue){
   if( pStmt==0 ) return XJD1_MISUSE;
+  if( pStmt->isRow && !pStmt->okValue
+   && pStmt->pCmd->eCmdType==TK_SELECT ){
+    stmtRenderRow(pStmt, &pStmt->retValue);
+    pStmt->okValue = 1;
+  }
   *pzValue = pStmt->retValue.zBuf;
   return XJD1_OK;
 }
 
+/*
+** Step a prepared statement up to mxRow times and render all of the
+** resulting rows into a single buffer, each row followed by a newline.
+** *pzRows is set to the buffer, *pnRow to the number of rows, and aiRow[i]
+** to the offset of row i.  aiRow[] must have room for mxRow+1 entries;
+** aiRow[*pnRow] is the total number of bytes.  The buffer is owned by
+** the statement and is valid until the next call to xjd1_stmt_step(),
+** xjd1_stmt_batch() or xjd1_stmt_rewind().
+**
+** Return XJD1_ROW if one or more rows were produced, or XJD1_DONE if
+** there were none.  Statements other than SELECT are run as if by
+** xjd1_stmt_step(), and return their value, if any, as a single row.
+*/
+int xjd1_stmt_batch(
+  xjd1_stmt *pStmt,            /* The statement to step */
+  int mxRow,                   /* Maximum number of rows to return */
+  const char **pzRows,         /* OUT: Text of all rows */
+  int *aiRow,                  /* OUT: Offset of each row in *pzRows */
+  int *pnRow                   /* OUT: Number of rows */
+){
+  Command *pCmd;
+  int nRow = 0;
+  int rc = XJD1_DONE;
+
+  if( pStmt==0 || mxRow<1 ) return XJD1_MISUSE;
+  *pzRows = "";
+  *pnRow = 0;
+  aiRow[0] = 0;
+  pCmd = pStmt->pCmd;
+  if( pCmd==0 || pCmd->eCmdType!=TK_SELECT ){
+    rc = xjd1_stmt_step(pStmt);
+    if( rc==XJD1_ROW && pStmt->okValue ){
+      xjd1StringAppend(&pStmt->retValue, "\n", 1);
+      aiRow[1] = pStmt->retValue.nUsed;
+      *pnRow = 1;
+      *pzRows = pStmt->retValue.zBuf;
+    }
+    return rc;
+  }
+
+  stmtClearRow(pStmt);
+  if( pStmt->isEof ) return pStmt->rcEof;
+  rc = stmtFlushAsync(pStmt);
+  if( rc ) return rc;
+  while( nRow<mxRow && (rc = xjd1QueryStep(pCmd->u.q.pQuery))==XJD1_ROW ){
+    aiRow[nRow++] = pStmt->retValue.nUsed;
+    stmtRenderRow(pStmt, &pStmt->retValue);
+    xjd1StringAppend(&pStmt->retValue, "\n", 1);
+  }
+  if( rc!=XJD1_ROW ){
+    /* The query has already reported its end.  Stepping it again would
+    ** start it over, so remember that and return XJD1_DONE next time.
+    ** If the query failed after some rows, those rows are returned now
+    ** and the error next time. */
+    pStmt->isEof = 1;
+    pStmt->rcEof = rc;
+  }
+  aiRow[nRow] = pStmt->retValue.nUsed;
+  *pnRow = nRow;
+  if( nRow>0 ){
+    *pzRows = pStmt->retValue.zBuf;
+    rc = XJD1_ROW;
+  }
+  return rc;
+}
+
+/*
+** Write into *ppValue the result of the most recent xjd1_stmt_step() on
+** a SELECT statement, for reading with the xjd1_value interfaces.  If
+** there is no current result, *ppValue is set to NULL.  The value is
+** owned by the statement.
+*/
+int xjd1_stmt_doc(xjd1_stmt *pStmt, xjd1_value **ppValue){
+  if( pStmt==0 ) return XJD1_MISUSE;
+  *ppValue = 0;
+  if( !pStmt->isRow ) return XJD1_OK;
+  if( pStmt->pResult==0 ){
+    pStmt->pResult = xjd1QueryDoc(pStmt->pCmd->u.q.pQuery, 0);
+  }
+  *ppValue = pStmt->pResult;
+  return XJD1_OK;
+}
+
+/*
+** Return the number of parameters in a prepared statement.
+*/
+int xjd1_stmt_bind_count(xjd1_stmt *pStmt){
+  return pStmt ? pStmt->nParam : 0;
+}
+
+/*
+** Return the index of the parameter named zName, with or without its
+** leading ':', or 0 if there is no such parameter.
+*/
+int xjd1_stmt_bind_index(xjd1_stmt *pStmt, const char *zName){
+  int i;
+  if( pStmt==0 || zName==0 ) return 0;
+  if( zName[0]==':' ) zName++;
+  for(i=0; i<pStmt->nParam; i++){
+    if( pStmt->azParam[i] && strcmp(pStmt->azParam[i], zName)==0 ){
+      return i+1;
+    }
+  }
+  return 0;
+}
+
+/*
+** Return the name of parameter i without its leading ':', or NULL if
+** parameter i is a "?" or does not exist.
+*/
+const char *xjd1_stmt_bind_name(xjd1_stmt *pStmt, int i){
+  if( pStmt==0 || i<1 || i>pStmt->nParam ) return 0;
+  return pStmt->azParam[i-1];
+}
+
+/*
+** Make pVal the value of parameter i, taking over the caller's reference
+** to pVal.  pVal is freed on error.
+*/
+static int stmtBind(xjd1_stmt *pStmt, int i, JsonNode *pVal){
+  if( pStmt==0 || i<1 || i>pStmt->nParam ){
+    xjd1JsonFree(pVal);
+    return XJD1_MISUSE;
+  }
+  xjd1JsonFree(pStmt->apParam[i-1]);
+  pStmt->apParam[i-1] = pVal;
+  return XJD1_OK;
+}
+
+/*
+** Bind values of various types to parameter i.
+*/
+int xjd1_stmt_bind_null(xjd1_stmt *pStmt, int i){
+  return stmtBind(pStmt, i, 0);
+}
+int xjd1_stmt_bind_int(xjd1_stmt *pStmt, int i, xjd1_int64 v){
+  JsonNode *pVal = xjd1JsonNew(0);
+  if( pVal==0 ) return XJD1_NOMEM;
+  pVal->eJType = XJD1_INT;
+  pVal->u.i = v;
+  return stmtBind(pStmt, i, pVal);
+}
+int xjd1_stmt_bind_real(xjd1_stmt *pStmt, int i, double r){
+  JsonNode *pVal = xjd1JsonNew(0);
+  if( pVal==0 ) return XJD1_NOMEM;
+  pVal->eJType = XJD1_REAL;
+  pVal->u.r = r;
+  return stmtBind(pStmt, i, pVal);
+}
+int xjd1_stmt_bind_text(xjd1_stmt *pStmt, int i, const char *z, int n){
+  JsonNode *pVal = xjd1JsonNew(0);
+  if( pVal==0 || xjd1JsonSetString(pVal, z, n) ){
+    xjd1JsonFree(pVal);
+    return XJD1_NOMEM;
+  }
+  return stmtBind(pStmt, i, pVal);
+}
+
+/*
+** Bind the JSON value in the n bytes of text at z to parameter i.  If
+** n is negative, z is zero-terminated.  Return XJD1_ERROR if z is not
+** well-formed JSON.
+*/
+int xjd1_stmt_bind_json(xjd1_stmt *pStmt, int i, const char *z, int n){
+  JsonNode *pVal = xjd1JsonParse(z, n);
+  if( pVal==0 ) return XJD1_ERROR;
+  return stmtBind(pStmt, i, pVal);
+}
+
+/*
+** Bind pVal, a value obtained from xjd1_stmt_doc() on this statement or
+** another statement of the same connection, to parameter i.  The
+** statement keeps its own reference, so the binding remains valid after
+** the other statement moves on.
+**
+** Reference counts on values are not synchronized.  A value must never
+** be bound to a statement of a different connection, which might be in
+** use by another thread.  Bind its text with xjd1_stmt_bind_json()
+** instead.
+*/
+int xjd1_stmt_bind_value(xjd1_stmt *pStmt, int i, xjd1_value *pVal){
+  return stmtBind(pStmt, i, xjd1JsonRef(pVal));
+}
+
+/*
+** Set all parameters of a prepared statement back to null.
+*/
+int xjd1_stmt_clear_bindings(xjd1_stmt *pStmt){
+  int i;
+  if( pStmt==0 ) return XJD1_MISUSE;
+  for(i=0; i<pStmt->nParam; i++){
+    xjd1JsonFree(pStmt->apParam[i]);
+    pStmt->apParam[i] = 0;
+  }
+  return XJD1_OK;
+}
+
 /*
 ** Construct a human-readable listing of a prepared statement showing
 ** its internal structure.  Used for debugging and analysis only.
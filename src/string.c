@@ -179,8 +179,6 @@ PRIVATE void xjd1StringRemovePrefix(String *pStr, int N){
 ** An "etByte" is an 8-bit unsigned value.
 */
 typedef unsigned char etByte;
-typedef long long int i64;
-typedef unsigned long long int u64;
 
 /*
 ** Each builtin conversion character (ex: the 'd' in "%d") is described
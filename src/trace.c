@@ -113,6 +113,7 @@ static const struct {
   { TK_ILLEGAL,          "TK_ILLEGAL"         },
   { TK_CREATECOLLECTION, "TK_CREATECOLLECTION"},
   { TK_DROPCOLLECTION,   "TK_DROPCOLLECTION"  },
+  { TK_PARAM,            "TK_PARAM"           },
 };
 
 /*
@@ -150,12 +151,16 @@ void xjd1TraceCommand(String *pOut, int indent, const Command *pCmd){
       break;
     }
     case TK_INSERT: {
-      xjd1StringAppendF(pOut, "%*sInsert: %s\n",
-         indent, "", pCmd->u.ins.zName);
+      xjd1StringAppendF(pOut, "%*sInsert: %s%s\n",
+         indent, "", pCmd->u.ins.zName,
+         pCmd->u.ins.isAsync ? " (async)" : "");
       if( pCmd->u.ins.pValue ){
          xjd1StringAppendF(pOut, "%*s value: ", indent, "");
          xjd1TraceExpr(pOut, pCmd->u.ins.pValue);
          xjd1StringAppend(pOut, "\n", 1);
+      }else if( pCmd->u.ins.pList ){
+         xjd1StringAppendF(pOut, "%*s values:\n", indent, "");
+         xjd1TraceExprList(pOut, indent+3, pCmd->u.ins.pList);
       }else{
          xjd1TraceQuery(pOut, indent+3, pCmd->u.ins.pQuery);
       }
@@ -314,6 +319,14 @@ void xjd1TraceExpr(String *pOut, const Expr *p){
       xjd1JsonRender(pOut, p->u.json.p);
       break;
     }
+    case TK_PARAM: {
+      if( p->u.param.zName ){
+        xjd1StringAppendF(pOut, ":%s", p->u.param.zName);
+      }else{
+        xjd1StringAppend(pOut, "?", 1);
+      }
+      break;
+    }
     case TK_STRUCT: {
       int i;
       ExprList *pList = p->u.st;
@@ -0,0 +1,203 @@
+/*
+** Copyright (c) 2011 D. Richard Hipp
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the Simplified BSD License (also
+** known as the "2-Clause License" or "FreeBSD License".)
+**
+** This program is distributed in the hope that it will be useful,
+** but without any warranty; without even the implied warranty of
+** merchantability or fitness for a particular purpose.
+**
+** Author contact information:
+**   drh@hwaci.com
+**   http://www.hwaci.com/drh/
+**
+*************************************************************************
+** Code to evaluate BEGIN, COMMIT and ROLLBACK, and to keep track of the
+** transactions that are open on a connection.
+**
+** An unnamed BEGIN, COMMIT or ROLLBACK maps to the SQLite command of the
+** same name.  A named one maps to a savepoint:
+**
+**      BEGIN name       ->  SAVEPOINT name
+**      COMMIT name      ->  RELEASE name
+**      ROLLBACK name    ->  ROLLBACK TO name; RELEASE name
+**
+** so named transactions nest, inside an unnamed one or on their own.
+*/
+#include "xjd1Int.h"
+
+/*
+** Forget the innermost transactions of pConn so that only nKeep remain.
+*/
+static void transPop(xjd1 *pConn, int nKeep){
+  while( pConn->nTrans>nKeep ){
+    xjd1_free(pConn->azTrans[--pConn->nTrans]);
+  }
+}
+
+/*
+** Record a new innermost transaction called zName, or an unnamed one if
+** zName is NULL.  Return XJD1_OK or XJD1_NOMEM.
+*/
+static int transPush(xjd1 *pConn, const char *zName){
+  char *zCopy = 0;
+  if( pConn->nTrans>=pConn->nTransAlloc ){
+    int nNew = pConn->nTransAlloc*2 + 4;
+    char **azNew = xjd1_realloc(pConn->azTrans, nNew*sizeof(char*));
+    if( azNew==0 ) return XJD1_NOMEM;
+    pConn->azTrans = azNew;
+    pConn->nTransAlloc = nNew;
+  }
+  if( zName ){
+    int n = xjd1Strlen30(zName);
+    zCopy = xjd1_malloc( n+1 );
+    if( zCopy==0 ) return XJD1_NOMEM;
+    memcpy(zCopy, zName, n+1);
+  }
+  pConn->azTrans[pConn->nTrans++] = zCopy;
+  return XJD1_OK;
+}
+
+/*
+** Return the number of transactions of pConn that are outside the
+** innermost one called zName, or -1 if there is no such transaction.
+*/
+static int transFind(xjd1 *pConn, const char *zName){
+  int i;
+  int n = xjd1Strlen30(zName);
+  for(i=pConn->nTrans-1; i>=0; i--){
+    const char *z = pConn->azTrans[i];
+    if( z && xjd1Strlen30(z)==n && sqlite3_strnicmp(z, zName, n)==0 ){
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*
+** Evaluate a BEGIN, COMMIT or ROLLBACK command.
+*/
+int xjd1TransStep(xjd1_stmt *pStmt){
+  Command *pCmd = pStmt->pCmd;
+  xjd1 *pConn = pStmt->pConn;
+  const char *zName = pCmd->u.trans.zTransId;
+  char *zSql;
+  char *zErr = 0;
+  int rc = XJD1_DONE;
+
+  switch( pCmd->eCmdType ){
+    case TK_BEGIN: {
+      zSql = zName ? sqlite3_mprintf("SAVEPOINT \"%w\"", zName)
+                   : sqlite3_mprintf("BEGIN");
+      break;
+    }
+    case TK_COMMIT: {
+      zSql = zName ? sqlite3_mprintf("RELEASE \"%w\"", zName)
+                   : sqlite3_mprintf("COMMIT");
+      break;
+    }
+    default: {
+      assert( pCmd->eCmdType==TK_ROLLBACK );
+      zSql = zName ? sqlite3_mprintf("ROLLBACK TO \"%w\"; RELEASE \"%w\"",
+                                     zName, zName)
+                   : sqlite3_mprintf("ROLLBACK");
+      break;
+    }
+  }
+  if( zSql==0 ){
+    xjd1Error(pConn, XJD1_NOMEM, 0);
+    return XJD1_NOMEM;
+  }
+  sqlite3_exec(pConn->db, zSql, 0, 0, &zErr);
+  sqlite3_free(zSql);
+  if( zErr ){
+    xjd1Error(pConn, XJD1_ERROR, "%s", zErr);
+    sqlite3_free(zErr);
+    rc = XJD1_ERROR;
+  }else if( pCmd->eCmdType==TK_BEGIN ){
+    if( transPush(pConn, zName) ){
+      xjd1Error(pConn, XJD1_NOMEM, 0);
+      rc = XJD1_NOMEM;
+    }
+  }else if( zName ){
+    int i = transFind(pConn, zName);
+    if( i>=0 ) transPop(pConn, i);
+  }else{
+    transPop(pConn, 0);
+  }
+
+  /* SQLite may have ended the transaction by itself, for example when
+  ** the outermost savepoint was released or after some errors. */
+  if( sqlite3_get_autocommit(pConn->db) ) transPop(pConn, 0);
+  return rc;
+}
+
+/*
+** Start a transaction to hold the writes of a single statement.  If a
+** transaction is already open, start a savepoint inside it instead, so
+** that a statement that fails part way through can be undone without
+** losing the earlier work of the enclosing transaction.  The return
+** value must be passed to xjd1TransEnd() once the statement is done.
+**
+** If neither can be started, leave an error in the connection and return
+** TRANS_ERROR.  The statement must then fail without writing anything.
+*/
+int xjd1TransBegin(xjd1 *pConn){
+  const char *zSql = "SAVEPOINT xjd1_stmt";
+  int isTrans = TRANS_SAVEPOINT;
+  if( sqlite3_get_autocommit(pConn->db) ){
+    zSql = "BEGIN";
+    isTrans = TRANS_BEGIN;
+  }
+  if( sqlite3_exec(pConn->db, zSql, 0, 0, 0)!=SQLITE_OK ){
+    xjd1Error(pConn, XJD1_ERROR, "%s", sqlite3_errmsg(pConn->db));
+    return TRANS_ERROR;
+  }
+  return isTrans;
+}
+
+/*
+** Finish a transaction or savepoint started by xjd1TransBegin().  Commit
+** it if rc is XJD1_OK, or roll it back otherwise.  Return rc, or
+** XJD1_ERROR if the commit fails.
+*/
+int xjd1TransEnd(xjd1 *pConn, int isTrans, int rc){
+  sqlite3 *db = pConn->db;
+  if( isTrans==TRANS_BEGIN ){
+    if( rc==XJD1_OK ){
+      if( sqlite3_exec(db, "COMMIT", 0, 0, 0)!=SQLITE_OK ){
+        xjd1Error(pConn, XJD1_ERROR, "%s", sqlite3_errmsg(db));
+        rc = XJD1_ERROR;
+      }
+    }
+    if( rc!=XJD1_OK ){
+      sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+    }
+  }else if( isTrans==TRANS_SAVEPOINT ){
+    if( rc!=XJD1_OK ){
+      sqlite3_exec(db, "ROLLBACK TO xjd1_stmt", 0, 0, 0);
+    }
+    sqlite3_exec(db, "RELEASE xjd1_stmt", 0, 0, 0);
+  }
+  return rc;
+}
+
+/*
+** Return the number of transactions, named or not, open on pConn.
+*/
+int xjd1TransDepth(xjd1 *pConn){
+  if( sqlite3_get_autocommit(pConn->db) ) transPop(pConn, 0);
+  return pConn->nTrans;
+}
+
+/*
+** Free the memory used to track the transactions of pConn.
+*/
+void xjd1TransClear(xjd1 *pConn){
+  transPop(pConn, 0);
+  xjd1_free(pConn->azTrans);
+  pConn->azTrans = 0;
+  pConn->nTransAlloc = 0;
+}
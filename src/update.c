@@ -25,32 +25,24 @@
 ** Otherwise, lookup or insert the zField element.
 */
 static JsonNode *findStructElement(JsonNode *pBase, const char *zField){
-  JsonStructElem *pElem;
+  JsonNode *pNew;
+  int i;
   if( pBase==0 ) return 0;
   if( pBase->eJType!=XJD1_STRUCT ){
 //    return 0;
     xjd1JsonToNull(pBase);
     pBase->eJType = XJD1_STRUCT;
-    pBase->u.st.pFirst = 0;
-    pBase->u.st.pLast = 0;
+    pBase->u.st.pShape = 0;
+    pBase->u.st.apValue = 0;
   }
-  for(pElem=pBase->u.st.pFirst; pElem; pElem=pElem->pNext){
-    if( strcmp(pElem->zLabel, zField)==0 ){
-      return pElem->pValue;
-    }
-  }
-  pElem = xjd1_malloc( sizeof(*pElem) );
-  if( pElem==0 ) return 0;
-  pElem->pNext = 0;
-  if( pBase->u.st.pLast==0 ){
-    pBase->u.st.pFirst = pElem;
-  }else{
-    pBase->u.st.pLast->pNext = pElem;
+  i = xjd1JsonStructFind(pBase, zField, -1);
+  if( i>=0 && pBase->u.st.apValue[i] ){
+    return pBase->u.st.apValue[i];
   }
-  pBase->u.st.pLast = pElem;
-  pElem->zLabel = xjd1PoolDup(0, zField, -1);
-  pElem->pValue = xjd1JsonNew(0);
-  return pElem->pValue;  
+  pNew = xjd1JsonNew(0);
+  if( pNew==0 ) return 0;
+  if( xjd1JsonInsert(pBase, zField, pNew) ) return 0;
+  return pNew;
 }
 
 /*
@@ -65,6 +57,7 @@ static JsonNode *findOrCreateJsonNode(JsonNode *pRoot, Expr *p){
     */
     case TK_DOT: {
       JsonNode *pBase = findOrCreateJsonNode(pRoot, p->u.lvalue.pLeft);
+      xjd1JsonDropSpan(pBase);
       return findStructElement(pBase, p->u.lvalue.zId);
     }
 
@@ -84,6 +77,7 @@ static JsonNode *findOrCreateJsonNode(JsonNode *pRoot, Expr *p){
     */
     case TK_LB: {
       JsonNode *pBase = findOrCreateJsonNode(pRoot, p->u.bi.pLeft);
+      xjd1JsonDropSpan(pBase);
       switch( pBase->eJType ){
         case XJD1_STRUCT: {
           JsonNode *pRes;
@@ -161,37 +155,44 @@ static void reviseOneField(
 }
 
 
+/*
+** Slots in xjd1_stmt.apSql[] used by UPDATE.  The WriteBuf uses slots
+** XJD1_SQL_WRITEBUF and above.
+*/
+#define UPDATE_SQL_QUERY    0    /* Scan the collection */
+#define UPDATE_SQL_UPSERT   1    /* Insert when nothing matched */
+
 /*
 ** Evaluate an UPDATE.
+**
+** The revised documents are collected in a WriteBuf while the collection
+** is scanned and written after the scan, inside a single transaction or
+** a savepoint if a transaction is already open.
 */
 int xjd1UpdateStep(xjd1_stmt *pStmt){
   Command *pCmd = pStmt->pCmd;
   int rc = XJD1_OK;
   int nUpdate = 0;
-  sqlite3 *db = pStmt->pConn->db;
-  sqlite3_stmt *pQuery, *pReplace;
-  char *zSql;
+  sqlite3_stmt *pQuery;
+  String jsonNewDoc;  /* Text rendering of revised document */
+  WriteBuf buf;
+  int isTrans;
 
   assert( pCmd!=0 );
   assert( pCmd->eCmdType==TK_UPDATE );
-  if( pCmd->u.update.pUpsert ){
-    sqlite3_exec(db, "BEGIN", 0, 0, 0);
-  }
-  zSql = sqlite3_mprintf("SELECT rowid, x FROM \"%w\"", pCmd->u.update.zName);
-  sqlite3_prepare_v2(db, zSql, -1, &pQuery, 0);
-  sqlite3_free(zSql);
-  zSql = sqlite3_mprintf("UPDATE \"%w\" SET x=?1 WHERE rowid=?2",
-                         pCmd->u.update.zName);
-  sqlite3_prepare_v2(db, zSql, -1, &pReplace, 0);
-  sqlite3_free(zSql);
-  if( pQuery && pReplace ){
-    while( SQLITE_ROW==sqlite3_step(pQuery) ){
+  isTrans = xjd1TransBegin(pStmt->pConn);
+  if( isTrans==TRANS_ERROR ) return XJD1_ERROR;
+  xjd1WriteBufInit(&buf, pStmt, pCmd->u.update.zName, 1);
+  pQuery = xjd1StmtSql(pStmt, UPDATE_SQL_QUERY,
+                       "SELECT rowid, x FROM \"%w\"", pCmd->u.update.zName);
+  xjd1StringInit(&jsonNewDoc, 0, 0);
+  if( pQuery ){
+    while( rc==XJD1_OK && SQLITE_ROW==sqlite3_step(pQuery) ){
       const char *zJson = (const char*)sqlite3_column_text(pQuery, 1);
       pStmt->pDoc = xjd1JsonParse(zJson, -1);
       if( pCmd->u.update.pWhere==0 || xjd1ExprTrue(pCmd->u.update.pWhere) ){
         JsonNode *pNewDoc;  /* Revised document content */
         ExprList *pChng;    /* List of changes */
-        String jsonNewDoc;  /* Text rendering of revised document */
         int i, n;
 
         pNewDoc = xjd1JsonEdit(xjd1JsonRef(pStmt->pDoc));
@@ -202,40 +203,30 @@ int xjd1UpdateStep(xjd1_stmt *pStmt){
           Expr *pExpr = pChng->apEItem[i+1].pExpr;
           reviseOneField(pNewDoc, pLvalue, pExpr);
         }
-        xjd1StringInit(&jsonNewDoc, 0, 0);
+        xjd1StringTruncate(&jsonNewDoc);
         xjd1JsonRender(&jsonNewDoc, pNewDoc);
-        sqlite3_bind_int64(pReplace, 2, sqlite3_column_int64(pQuery, 0));
-        sqlite3_bind_text(pReplace, 1, xjd1StringText(&jsonNewDoc), -1,
-                          SQLITE_STATIC);
-        sqlite3_step(pReplace);
-        sqlite3_reset(pReplace);
-        xjd1StringClear(&jsonNewDoc);
+        rc = xjd1WriteBufAdd(&buf, sqlite3_column_int64(pQuery, 0),
+                             xjd1StringText(&jsonNewDoc),
+                             xjd1StringLen(&jsonNewDoc));
         xjd1JsonFree(pNewDoc);
         nUpdate++;
       }
       xjd1JsonFree(pStmt->pDoc);
       pStmt->pDoc = 0;
     }  
+    sqlite3_reset(pQuery);
+    if( rc==XJD1_OK ) rc = xjd1WriteBufApply(&buf);
   }
-  sqlite3_finalize(pQuery);
-  sqlite3_finalize(pReplace);
+  xjd1StringClear(&jsonNewDoc);
+  xjd1WriteBufClear(&buf);
 
-  if( pCmd->u.update.pUpsert ){
+  if( rc==XJD1_OK && pCmd->u.update.pUpsert ){
     if( nUpdate==0 ){
       JsonNode *pToIns;
-      String jsonToIns;
       pToIns = xjd1ExprEval(pCmd->u.update.pUpsert);
-      xjd1StringInit(&jsonToIns, 0, 0); 
-      xjd1JsonRender(&jsonToIns, pToIns);
+      xjd1InsertDoc(pStmt, UPDATE_SQL_UPSERT, pCmd->u.update.zName, pToIns);
       xjd1JsonFree(pToIns);
-      zSql = sqlite3_mprintf(
-           "INSERT INTO \"%w\" VALUES('%q')",
-           pCmd->u.update.zName, xjd1StringText(&jsonToIns));
-      xjd1StringClear(&jsonToIns);
-      sqlite3_exec(db, zSql, 0, 0, 0);
-      sqlite3_free(zSql);
     }
-    sqlite3_exec(db, "COMMIT", 0, 0, 0);
   }
-  return rc;
+  return xjd1TransEnd(pStmt->pConn, isTrans, rc);
 }
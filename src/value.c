@@ -0,0 +1,111 @@
+/*
+** Copyright (c) 2011 D. Richard Hipp
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the Simplified BSD License (also
+** known as the "2-Clause License" or "FreeBSD License".)
+**
+** This program is distributed in the hope that it will be useful,
+** but without any warranty; without even the implied warranty of
+** merchantability or fitness for a particular purpose.
+**
+** Author contact information:
+**   drh@hwaci.com
+**   http://www.hwaci.com/drh/
+**
+*************************************************************************
+** Read-only access to result values.
+**
+** An xjd1_value is a JsonNode.  These interfaces allow an application to
+** read the fields of a result directly, without rendering the result as
+** text and parsing that text again.  A NULL xjd1_value is treated as a
+** JSON null.
+*/
+#include "xjd1Int.h"
+
+/*
+** Return the datatype of a value.  One of XJD1_FALSE, XJD1_TRUE,
+** XJD1_REAL, XJD1_NULL, XJD1_STRING, XJD1_ARRAY, XJD1_STRUCT or XJD1_INT.
+*/
+int xjd1_value_type(xjd1_value *p){
+  if( p==0 ) return XJD1_NULL;
+  return p->eJType;
+}
+
+/*
+** Return the value as a real number.  Strings are converted.  Other
+** values that are not numbers give 0.0.
+*/
+double xjd1_value_real(xjd1_value *p){
+  double r;
+  if( xjd1JsonToReal(p, &r) ) return 0.0;
+  return r;
+}
+
+/*
+** Return the value as a 64-bit integer.  Reals are truncated toward
+** zero and clamped to the range of the integer.  Strings are converted.
+** Other values that are not numbers give 0.
+*/
+xjd1_int64 xjd1_value_int(xjd1_value *p){
+  i64 i;
+  if( xjd1JsonToInt(p, &i) ) return 0;
+  return i;
+}
+
+/*
+** Return the text of an XJD1_STRING value, or NULL for any other type.
+** If pnByte is not NULL, the length of the text in bytes is written
+** into *pnByte.  The text is not necessarily zero-terminated.
+*/
+const char *xjd1_value_text(xjd1_value *p, int *pnByte){
+  if( p==0 || p->eJType!=XJD1_STRING ){
+    if( pnByte ) *pnByte = 0;
+    return 0;
+  }
+  if( pnByte ) *pnByte = xjd1JsonStrLen(p);
+  return xjd1JsonStrText(p);
+}
+
+/*
+** Return the number of elements in an array or the number of members of
+** a structure.  Return 0 for any other type.
+*/
+int xjd1_value_count(xjd1_value *p){
+  if( p==0 ) return 0;
+  if( p->eJType==XJD1_ARRAY ) return p->u.ar.nElem;
+  if( p->eJType==XJD1_STRUCT ) return xjd1JsonStructCount(p);
+  return 0;
+}
+
+/*
+** Return the i-th element of an array or the value of the i-th member
+** of a structure.  Return NULL if there is no such element.
+*/
+xjd1_value *xjd1_value_element(xjd1_value *p, int i){
+  if( i<0 || i>=xjd1_value_count(p) ) return 0;
+  if( p->eJType==XJD1_ARRAY ) return p->u.ar.apElem[i];
+  return p->u.st.apValue[i];
+}
+
+/*
+** Return the label of the i-th member of a structure, or NULL if p
+** is not a structure or has no such member.  The label is zero-terminated.
+*/
+const char *xjd1_value_label(xjd1_value *p, int i){
+  if( p==0 || p->eJType!=XJD1_STRUCT ) return 0;
+  if( i<0 || i>=xjd1JsonStructCount(p) ) return 0;
+  return p->u.st.pShape->azLabel[i];
+}
+
+/*
+** Return the value of the member of a structure with label zLabel, or
+** NULL if p is not a structure or has no such member.
+*/
+xjd1_value *xjd1_value_lookup(xjd1_value *p, const char *zLabel){
+  int i;
+  if( p==0 || p->eJType!=XJD1_STRUCT ) return 0;
+  i = xjd1JsonStructFind(p, zLabel, -1);
+  if( i<0 ) return 0;
+  return p->u.st.apValue[i];
+}
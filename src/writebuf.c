@@ -0,0 +1,240 @@
+/*
+** Copyright (c) 2011 D. Richard Hipp
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the Simplified BSD License (also
+** known as the "2-Clause License" or "FreeBSD License".)
+**
+** This program is distributed in the hope that it will be useful,
+** but without any warranty; without even the implied warranty of
+** merchantability or fitness for a particular purpose.
+**
+** Author contact information:
+**   drh@hwaci.com
+**   http://www.hwaci.com/drh/
+**
+*************************************************************************
+** A WriteBuf gathers the rows that an UPDATE or DELETE is going to change
+** while the collection is being scanned, and applies all the changes
+** once the scan is over.
+**
+** Rows are kept in memory until they use more than xjd1.mxWriteBuf bytes.
+** After that they are spilled into a temporary table.  Rows held in
+** memory are deleted IN batches of WRITEBUF_BATCH rowids, or updated one
+** by one, in rowid order, using statements that are prepared once per
+** xjd1_stmt.  Spilled rows are applied with a single statement.
+*/
+#include "xjd1Int.h"
+
+/* Number of rowids deleted by each DELETE ... WHERE rowid IN (...) */
+#define WRITEBUF_BATCH 100
+
+/* Slots in xjd1_stmt.apSql[] used by a WriteBuf */
+#define WRITEBUF_SQL_SPILL  (XJD1_SQL_WRITEBUF+0)  /* Add a row to _xjd1_spill */
+#define WRITEBUF_SQL_APPLY  (XJD1_SQL_WRITEBUF+1)  /* Apply rows in memory */
+#define WRITEBUF_SQL_MERGE  (XJD1_SQL_WRITEBUF+2)  /* Apply spilled rows */
+#define WRITEBUF_SQL_FORGET (XJD1_SQL_WRITEBUF+3)  /* Empty _xjd1_spill */
+
+/*
+** Prepare to gather changes to collection zName on behalf of pStmt.
+** If isUpdate is true, each row comes with the new text of its document.
+** Otherwise the rows are to be deleted.
+*/
+void xjd1WriteBufInit(
+  WriteBuf *p,                   /* The buffer to initialize */
+  xjd1_stmt *pStmt,              /* Statement that owns the buffer */
+  const char *zName,             /* Collection that is changed */
+  int isUpdate                   /* True for UPDATE, false for DELETE */
+){
+  memset(p, 0, sizeof(*p));
+  p->pStmt = pStmt;
+  p->zName = zName;
+  p->isUpdate = isUpdate;
+  xjd1StringInit(&p->sDoc, 0, 0);
+}
+
+/*
+** Report the most recent SQLite error against the connection of p.
+*/
+static int writeBufError(WriteBuf *p){
+  xjd1 *pConn = p->pStmt->pConn;
+  xjd1Error(pConn, XJD1_ERROR, "%s", sqlite3_errmsg(pConn->db));
+  return XJD1_ERROR;
+}
+
+/*
+** Run pSql, which has no result rows, and reset it.  Return XJD1_OK or
+** XJD1_ERROR.
+*/
+static int writeBufRun(WriteBuf *p, sqlite3_stmt *pSql){
+  int rc;
+  if( pSql==0 ) return writeBufError(p);
+  rc = sqlite3_step(pSql);
+  sqlite3_reset(pSql);
+  if( rc!=SQLITE_DONE && rc!=SQLITE_ROW ) return writeBufError(p);
+  return XJD1_OK;
+}
+
+/*
+** Move every row held in memory into the _xjd1_spill table.
+*/
+static int writeBufSpill(WriteBuf *p){
+  sqlite3_stmt *pSpill;
+  int i;
+  if( !p->isSpilled ){
+    sqlite3 *db = p->pStmt->pConn->db;
+    if( sqlite3_exec(db, "CREATE TEMP TABLE IF NOT EXISTS "
+                         "_xjd1_spill(x INTEGER PRIMARY KEY, y)", 0, 0, 0) ){
+      return writeBufError(p);
+    }
+    p->isSpilled = 1;
+  }
+  pSpill = xjd1StmtSql(p->pStmt, WRITEBUF_SQL_SPILL,
+                       "INSERT OR REPLACE INTO _xjd1_spill(x,y) VALUES(?1,?2)");
+  if( pSpill==0 ) return writeBufError(p);
+  for(i=0; i<p->nRow; i++){
+    sqlite3_bind_int64(pSpill, 1, p->aRowid[i]);
+    if( p->isUpdate ){
+      sqlite3_bind_text(pSpill, 2, &p->sDoc.zBuf[p->aiDoc[i]],
+                        p->aiDoc[i+1] - p->aiDoc[i], SQLITE_STATIC);
+    }
+    if( writeBufRun(p, pSpill) ) return XJD1_ERROR;
+  }
+  p->nRow = 0;
+  p->nByte = 0;
+  xjd1StringTruncate(&p->sDoc);
+  return XJD1_OK;
+}
+
+/*
+** Add a row to the buffer.  For an UPDATE, zDoc[0..nDoc-1] is the new
+** text of its document.  Return XJD1_OK, or an error code after leaving
+** a message in the connection.
+*/
+int xjd1WriteBufAdd(WriteBuf *p, i64 iRowid, const char *zDoc, int nDoc){
+  if( p->nRow+1>=p->nAlloc ){
+    int nNew = p->nAlloc*2 + 64;
+    i64 *aNew = xjd1_realloc(p->aRowid, nNew*sizeof(i64));
+    int *aiNew;
+    if( aNew==0 ) goto writebuf_nomem;
+    p->aRowid = aNew;
+    if( p->isUpdate ){
+      aiNew = xjd1_realloc(p->aiDoc, nNew*sizeof(int));
+      if( aiNew==0 ) goto writebuf_nomem;
+      p->aiDoc = aiNew;
+    }
+    p->nAlloc = nNew;
+  }
+  p->aRowid[p->nRow] = iRowid;
+  p->nByte += sizeof(i64);
+  if( p->isUpdate ){
+    p->aiDoc[p->nRow] = xjd1StringLen(&p->sDoc);
+    if( xjd1StringAppend(&p->sDoc, zDoc, nDoc)!=nDoc ) goto writebuf_nomem;
+    p->aiDoc[p->nRow+1] = xjd1StringLen(&p->sDoc);
+    p->nByte += sizeof(int) + nDoc;
+  }
+  p->nRow++;
+  p->nChange++;
+  if( p->nByte>p->pStmt->pConn->mxWriteBuf ){
+    return writeBufSpill(p);
+  }
+  return XJD1_OK;
+
+writebuf_nomem:
+  xjd1Error(p->pStmt->pConn, XJD1_NOMEM, 0);
+  return XJD1_NOMEM;
+}
+
+/*
+** Delete the rows held in memory, WRITEBUF_BATCH at a time.  Unused
+** parameters of the last batch are left NULL, which matches nothing.
+*/
+static int writeBufDelete(WriteBuf *p){
+  sqlite3_stmt *pDel;
+  int i, j;
+  pDel = p->pStmt->apSql[WRITEBUF_SQL_APPLY];
+  if( pDel==0 ){
+    String vars;
+    xjd1StringInit(&vars, 0, 0);
+    xjd1StringAppend(&vars, "?1", 2);
+    for(i=2; i<=WRITEBUF_BATCH; i++) xjd1StringAppendF(&vars, ",?%d", i);
+    pDel = xjd1StmtSql(p->pStmt, WRITEBUF_SQL_APPLY,
+                       "DELETE FROM \"%w\" WHERE rowid IN (%s)",
+                       p->zName, xjd1StringText(&vars));
+    xjd1StringClear(&vars);
+    if( pDel==0 ) return writeBufError(p);
+  }
+  for(i=0; i<p->nRow; i+=WRITEBUF_BATCH){
+    sqlite3_clear_bindings(pDel);
+    for(j=0; j<WRITEBUF_BATCH && i+j<p->nRow; j++){
+      sqlite3_bind_int64(pDel, j+1, p->aRowid[i+j]);
+    }
+    if( writeBufRun(p, pDel) ) return XJD1_ERROR;
+  }
+  return XJD1_OK;
+}
+
+/*
+** Write the new text of each document held in memory.
+*/
+static int writeBufUpdate(WriteBuf *p){
+  sqlite3_stmt *pUpd;
+  int i;
+  pUpd = xjd1StmtSql(p->pStmt, WRITEBUF_SQL_APPLY,
+                     "UPDATE \"%w\" SET x=?1 WHERE rowid=?2", p->zName);
+  if( pUpd==0 ) return writeBufError(p);
+  for(i=0; i<p->nRow; i++){
+    sqlite3_bind_text(pUpd, 1, &p->sDoc.zBuf[p->aiDoc[i]],
+                      p->aiDoc[i+1] - p->aiDoc[i], SQLITE_STATIC);
+    sqlite3_bind_int64(pUpd, 2, p->aRowid[i]);
+    if( writeBufRun(p, pUpd) ) return XJD1_ERROR;
+  }
+  return XJD1_OK;
+}
+
+/*
+** Apply every change gathered by the buffer.  Return XJD1_OK, or an
+** error code after leaving a message in the connection.
+*/
+int xjd1WriteBufApply(WriteBuf *p){
+  xjd1_stmt *pStmt = p->pStmt;
+  sqlite3_stmt *pSql;
+  int rc;
+
+  if( !p->isSpilled ){
+    rc = p->isUpdate ? writeBufUpdate(p) : writeBufDelete(p);
+  }else{
+    rc = writeBufSpill(p);
+    if( rc==XJD1_OK ){
+      if( p->isUpdate ){
+        pSql = xjd1StmtSql(pStmt, WRITEBUF_SQL_MERGE,
+            "UPDATE \"%w\" SET x=(SELECT y FROM _xjd1_spill"
+            " WHERE _xjd1_spill.x=\"%w\".rowid)"
+            " WHERE rowid IN (SELECT x FROM _xjd1_spill)",
+            p->zName, p->zName);
+      }else{
+        pSql = xjd1StmtSql(pStmt, WRITEBUF_SQL_MERGE,
+            "DELETE FROM \"%w\" WHERE rowid IN (SELECT x FROM _xjd1_spill)",
+            p->zName);
+      }
+      rc = writeBufRun(p, pSql);
+    }
+    pSql = xjd1StmtSql(pStmt, WRITEBUF_SQL_FORGET, "DELETE FROM _xjd1_spill");
+    if( writeBufRun(p, pSql) && rc==XJD1_OK ) rc = XJD1_ERROR;
+    p->isSpilled = 0;
+  }
+  p->nRow = 0;
+  p->nByte = 0;
+  xjd1StringTruncate(&p->sDoc);
+  return rc;
+}
+
+/*
+** Free the memory held by a WriteBuf.
+*/
+void xjd1WriteBufClear(WriteBuf *p){
+  xjd1_free(p->aRowid);
+  xjd1_free(p->aiDoc);
+  xjd1StringClear(&p->sDoc);
+  memset(p, 0, sizeof(*p));
+}
@@ -40,13 +40,36 @@ typedef struct xjd1 xjd1;
 /* A prepared statement */
 typedef struct xjd1_stmt xjd1_stmt;
 
+/* A value, or a part of a value, returned by a prepared statement */
+typedef struct JsonNode xjd1_value;
+
+/* 64-bit signed integer */
+typedef long long int xjd1_int64;
+
+/* Datatypes returned by xjd1_value_type() */
+#define XJD1_FALSE     0
+#define XJD1_TRUE      1
+#define XJD1_REAL      2
+#define XJD1_NULL      3
+#define XJD1_STRING    4
+#define XJD1_ARRAY     5
+#define XJD1_STRUCT    6
+#define XJD1_INT       7
+
 /* Create, setup, and destroy an execution context */
 int xjd1_context_new(xjd1_context**);
 int xjd1_context_config(xjd1_context*, int, ...);
 int xjd1_context_delete(xjd1_context*);
 
 /* Operators for xjd1_context_config() */
-#define XJD1_CONTEXT_LOG   1
+#define XJD1_CONTEXT_LOG   1   /* int(*)(const char*,void*), void* */
+#define XJD1_CONTEXT_WAL   2   /* int onoff */
+
+/* Return true if the library was built with THREADSAFE=1.  A connection,
+** and the statements prepared on it, must only be used by one thread at
+** a time.  Other connections, including connections that share the same
+** context, may be used by other threads at the same time. */
+int xjd1_threadsafe(void);
 
 /* Open and close a database connection */
 int xjd1_open(xjd1_context*, const char *zURI, xjd1**);
@@ -55,6 +78,18 @@ int xjd1_close(xjd1*);
 
 /* Operators for xjd1_config() */
 #define XJD1_CONFIG_PARSERTRACE    1
+#define XJD1_CONFIG_STMTCACHE      2   /* int nMax */
+#define XJD1_CONFIG_STMTCACHE_STAT 3   /* int *pnHit, int *pnMiss */
+#define XJD1_CONFIG_TRANSACTION    4   /* int *pnOpen */
+#define XJD1_CONFIG_WRITEBUF       5   /* int nByte */
+#define XJD1_CONFIG_ASYNC          6   /* int nDoc, int msWindow */
+
+/* Write the documents queued by ASYNC INSERT statements, and wait for
+** the writer thread, if there is one, to write its documents.  Without
+** a writer thread the queue is only written during calls on the
+** connection, so call this before leaving a connection idle with
+** documents queued. */
+int xjd1_flush(xjd1*);
 
 /* Report on recent errors */
 int xjd1_errcode(xjd1*);
@@ -66,10 +101,48 @@ int xjd1_stmt_new(xjd1*, const char*, xjd1_stmt**, int*);
 int xjd1_stmt_delete(xjd1_stmt*);
 int xjd1_stmt_config(xjd1_stmt*, int, ...);
 
+/* Operators for xjd1_stmt_config() */
+#define XJD1_STMT_SINK    1
+
 /* Process a prepared statement */
 int xjd1_stmt_step(xjd1_stmt*);
 int xjd1_stmt_rewind(xjd1_stmt*);
 int xjd1_stmt_value(xjd1_stmt*, const char**);
+int xjd1_stmt_batch(xjd1_stmt*, int, const char**, int*, int*);
+int xjd1_stmt_doc(xjd1_stmt*, xjd1_value**);
+
+/* Insert every document of a JSON array or newline-delimited JSON text
+** into a collection, in one transaction.  xjd1_load_stream() reads the
+** text in chunks from a callback instead of from memory. */
+int xjd1_load(xjd1*, const char *zCollection, const char*, int, int*);
+int xjd1_load_stream(xjd1*, const char *zCollection,
+                     int(*)(void*,char*,int), void*, int*);
+
+/* Bind values to the "?" and ":name" parameters of a prepared statement.
+** Parameters are numbered from 1.  Bindings are kept across calls to
+** xjd1_stmt_rewind().  An unbound parameter is null. */
+int xjd1_stmt_bind_count(xjd1_stmt*);
+int xjd1_stmt_bind_index(xjd1_stmt*, const char *zName);
+const char *xjd1_stmt_bind_name(xjd1_stmt*, int);
+int xjd1_stmt_bind_null(xjd1_stmt*, int);
+int xjd1_stmt_bind_int(xjd1_stmt*, int, xjd1_int64);
+int xjd1_stmt_bind_real(xjd1_stmt*, int, double);
+int xjd1_stmt_bind_text(xjd1_stmt*, int, const char*, int);
+int xjd1_stmt_bind_json(xjd1_stmt*, int, const char*, int);
+int xjd1_stmt_bind_value(xjd1_stmt*, int, xjd1_value*);
+int xjd1_stmt_clear_bindings(xjd1_stmt*);
+
+/* Read a value returned by xjd1_stmt_doc().  Values remain valid until
+** the next call to xjd1_stmt_step(), xjd1_stmt_batch(), xjd1_stmt_rewind()
+** or xjd1_stmt_delete() on the same statement. */
+int xjd1_value_type(xjd1_value*);
+double xjd1_value_real(xjd1_value*);
+xjd1_int64 xjd1_value_int(xjd1_value*);
+const char *xjd1_value_text(xjd1_value*, int*);
+int xjd1_value_count(xjd1_value*);
+xjd1_value *xjd1_value_element(xjd1_value*, int);
+const char *xjd1_value_label(xjd1_value*, int);
+xjd1_value *xjd1_value_lookup(xjd1_value*, const char*);
 
 /* Return true if zStmt is a complete query statement */
 int xjd1_complete(const char *zStmt);
@@ -27,6 +27,46 @@
 #include <stdlib.h>
 #include <stdarg.h>
 
+/* Number of SQLite statements that a single xjd1_stmt can hold
+** prepared across calls to xjd1_stmt_step() and xjd1_stmt_rewind().
+** Slots XJD1_SQL_WRITEBUF and above are used by WriteBuf.
+*/
+#define XJD1_STMT_NSQL    8
+#define XJD1_SQL_WRITEBUF 4
+
+/* Default number of bytes of changes that an UPDATE or DELETE holds in
+** memory before spilling them to a temporary table.  Change at run-time
+** with XJD1_CONFIG_WRITEBUF.
+*/
+#ifndef XJD1_DEFAULT_WRITEBUF
+# define XJD1_DEFAULT_WRITEBUF (4*1024*1024)
+#endif
+
+/* Default limits of the ASYNC INSERT queue of a connection: the number
+** of documents, and the age in milliseconds of the oldest one, at which
+** the queue is written.  Change at run-time with XJD1_CONFIG_ASYNC.
+*/
+#ifndef XJD1_DEFAULT_ASYNC_BATCH
+# define XJD1_DEFAULT_ASYNC_BATCH 1000
+#endif
+#ifndef XJD1_DEFAULT_ASYNC_WINDOW
+# define XJD1_DEFAULT_ASYNC_WINDOW 100
+#endif
+
+/* Milliseconds a connection waits for another connection to finish
+** writing before it gives up with an error.
+*/
+#ifndef XJD1_DEFAULT_BUSY_TIMEOUT
+# define XJD1_DEFAULT_BUSY_TIMEOUT 5000
+#endif
+
+/* Default number of statements in the statement cache of a connection.
+** Change at run-time with XJD1_CONFIG_STMTCACHE.
+*/
+#ifndef XJD1_DEFAULT_STMTCACHE
+# define XJD1_DEFAULT_STMTCACHE 20
+#endif
+
 /* Marker for routines not intended for external use */
 #define PRIVATE
 
@@ -42,6 +82,7 @@
 #define TK_ARRAY             105
 #define TK_STRUCT            106
 #define TK_JVALUE            107
+#define TK_PARAM             108
 
 /*
 ** A convenience macro for returning the size of an fixed-size array. 
@@ -54,7 +95,13 @@
 
 typedef unsigned char u8;
 typedef unsigned short int u16;
+typedef unsigned int u32;
+typedef long long int i64;
+typedef unsigned long long int u64;
 typedef struct AggExpr AggExpr;
+typedef struct AsyncDoc AsyncDoc;
+typedef struct AsyncQueue AsyncQueue;
+typedef struct AsyncWriter AsyncWriter;
 typedef struct Aggregate Aggregate;
 typedef struct Command Command;
 typedef struct DataSrc DataSrc;
@@ -64,7 +111,8 @@ typedef struct ExprList ExprList;
 typedef struct FlattenIter FlattenIter;
 typedef struct Function Function;
 typedef struct JsonNode JsonNode;
-typedef struct JsonStructElem JsonStructElem;
+typedef struct JsonShape JsonShape;
+typedef struct JsonSrc JsonSrc;
 typedef struct Parse Parse;
 typedef struct PoolChunk PoolChunk;
 typedef struct Pool Pool;
@@ -73,6 +121,7 @@ typedef struct String String;
 typedef struct Token Token;
 typedef struct ResultList ResultList;
 typedef struct ResultItem ResultItem;
+typedef struct WriteBuf WriteBuf;
 
 /* A single allocation from the Pool allocator */
 struct PoolChunk {
@@ -81,7 +130,9 @@ struct PoolChunk {
 
 /* A memory allocation pool */
 struct Pool {
-  PoolChunk *pChunk;                /* List of all memory allocations */
+  PoolChunk *pChunk;                /* Chunks in use */
+  PoolChunk *pLarge;                /* Oversized allocations */
+  PoolChunk *pFree;                 /* Chunks kept by xjd1PoolReset() */
   char *pSpace;                     /* Space available for allocation */
   int nSpace;                       /* Bytes available in pSpace */
 };
@@ -96,12 +147,39 @@ struct String {
 
 /* Execution context */
 struct xjd1_context {
+  sqlite3_mutex *pMutex;            /* Guards the fields below, or NULL */
   int nRef;                         /* Reference count */
   u8 isDying;                       /* True if has been deleted */
+  u8 isWal;                         /* Open connections in WAL mode */
   int (*xLog)(const char*,void*);   /* Error logging function */
   void *pLogArg;                    /* 2nd argument to xLog() */
 };
 
+/* A document waiting in an AsyncQueue.  Both the collection name and
+** the text of the document are held in AsyncQueue.sText. */
+struct AsyncDoc {
+  int iName;                        /* Offset of the zero-terminated name */
+  int iDoc;                         /* Offset of the document text */
+  int nDoc;                         /* Bytes of document text */
+};
+
+/* Documents of ASYNC INSERT statements not yet written.  See async.c */
+struct AsyncQueue {
+  int nDoc;                         /* Documents waiting */
+  int nAlloc;                       /* Slots allocated in aDoc */
+  AsyncDoc *aDoc;                   /* The documents, oldest first */
+  String sText;                     /* Names and texts of the documents */
+  int iLastName;                    /* Offset of the latest name, or -1 */
+  i64 iFirst;                       /* When aDoc[0] was queued, in ms */
+  int mxDoc;                        /* Write when this many are waiting */
+  int msWindow;                     /* Write when aDoc[0] is this old */
+  sqlite3_stmt *pIns;               /* INSERT for collection zIns */
+  char *zIns;                       /* Collection that pIns writes */
+  AsyncWriter *pWriter;             /* Writer thread, or NULL */
+  int nSent;                        /* Given to pWriter since last drained */
+  u8 noWriter;                      /* True if pWriter cannot be started */
+};
+
 /* An open database connection */
 struct xjd1 {
   xjd1_context *pContext;           /* Execution context */
@@ -110,6 +188,16 @@ struct xjd1 {
   u8 parserTrace;                   /* True to enable parser tracing */
   u8 appendErr;                     /* append errMsg rather than overwrite */
   xjd1_stmt *pStmt;                 /* list of all prepared statements */
+  xjd1_stmt *pCache;                /* Statement cache, most recent first */
+  int nCache;                       /* Number of statements in pCache */
+  int mxCache;                      /* Maximum number of cached statements */
+  int nCacheHit;                    /* Statements taken from pCache */
+  int nCacheMiss;                   /* Statements not found in pCache */
+  int mxWriteBuf;                   /* Memory budget of a WriteBuf */
+  AsyncQueue sAsync;                /* Queued ASYNC INSERT documents */
+  int nTrans;                       /* Number of open transactions */
+  int nTransAlloc;                  /* Slots allocated in azTrans */
+  char **azTrans;                   /* Name of each, or NULL, innermost last */
   sqlite3 *db;                      /* Storage engine */
   int errCode;                      /* Latest non-zero error code */
   String errMsg;                    /* Latest error message */
@@ -123,10 +211,24 @@ struct xjd1_stmt {
   int nRef;                         /* Reference count */
   u8 isDying;                       /* True if has been closed */
   char *zCode;                      /* Text of the query */
+  int nCode;                        /* Bytes of zCode used.  0 on error */
+  u8 noCache;                       /* True if a collection was missing */
+  u8 isCached;                      /* True if in the statement cache */
   Command *pCmd;                    /* Parsed command */
   JsonNode *pDoc;                   /* Current document */
+  int nParam;                       /* Number of parameters */
+  char **azParam;                   /* Name of each parameter, or NULL */
+  JsonNode **apParam;               /* Value bound to each parameter */
   int okValue;                      /* True if retValue is valid */
   String retValue;                  /* String rendering of return value */
+  u8 isRow;                         /* True if a SELECT row is current */
+  u8 isEof;                         /* True once a query or pragma has ended */
+  int rcEof;                        /* Result of a SELECT step after isEof */
+  JsonNode *pResult;                /* Result for xjd1_stmt_doc(), or NULL */
+  int (*xSink)(void*,const char*,int);  /* Receives each result row */
+  void *pSinkArg;                   /* First argument to xSink */
+  sqlite3_stmt *apSql[XJD1_STMT_NSQL]; /* SQL kept by xjd1StmtSql() */
+  i64 iMaxRowid;                    /* INSERT ... SELECT reads rows up to this */
 
   int errCode;                      /* Error code */
   String errMsg;                    /* Error message */
@@ -181,6 +283,8 @@ struct Expr {
     struct {                /* Substructure nam.  eClass==EXPR_LVALUE */
       Expr *pLeft;             /* Lvalue or id to the left */
       char *zId;               /* ID to the right */
+      u64 iShapeId;            /* Shape last seen by TK_DOT.  0 for none */
+      int iSlot;               /* Slot of zId in shape iShapeId, or -1 */
     } lvalue;
     struct {                /* Identifiers */
       char *zId;               /* token value.  eClass=EXPR_TK */
@@ -207,6 +311,10 @@ struct Expr {
       Expr *pIfTrue;        /* B in A?B:C */
       Expr *pIfFalse;       /* C in A?B:C */
     } tri;
+    struct {                /* Parameter.  eClass==EXPR_PARAM */
+      int iParam;              /* Index in xjd1_stmt.apParam[] */
+      char *zName;             /* Name of a ":name" parameter.  NULL for "?" */
+    } param;
   } u;
 };
 #define XJD1_EXPR_BI      1
@@ -218,41 +326,115 @@ struct Expr {
 #define XJD1_EXPR_STRUCT  7
 #define XJD1_EXPR_LVALUE  8
 #define XJD1_EXPR_TRI     9
+#define XJD1_EXPR_PARAM  10
+
+/*
+** The layout of a JSON structure: the ordered list of its labels.
+**
+** Shapes are interned in a global hash table (see json.c) so that every
+** structure with the same sequence of labels shares a single JsonShape.
+** Each shape is assigned a unique iShapeId when it is created.  Ids are
+** 64 bits wide and never reused, so an (iShapeId, slot) pair remembered
+** by an expression remains a valid cache key even after the shape itself
+** is freed.
+**
+** Labels of small shapes are searched linearly.  Once a shape is wider
+** than JSON_SHAPE_HASH_MIN labels, an open-addressing hash index is
+** built the first time a label is looked up in it.
+*/
+struct JsonShape {
+  int nRef;                 /* Number of structures using this shape */
+  int nLabel;               /* Number of labels */
+  u64 iShapeId;             /* Unique identifier for this shape */
+  u32 iHash;                /* Hash of all labels, in order */
+  u8 hasDup;                /* True if some label occurs more than once */
+  JsonShape *pHashNext;     /* Next shape in the same hash bucket */
+  char **azLabel;           /* Label for each slot.  Zero-terminated */
+  int *anLabel;             /* Length of each label in bytes */
+  int nSlotHash;            /* Size of aSlotHash[].  Power of 2, or 0 */
+  int *aSlotHash;           /* Label hash index: slot+1, or 0 if empty */
+};
+
+/* Values for JsonNode.eStr.  Strings of up to XJD1_SHORT_STR bytes are
+** stored inside the JsonNode itself, avoiding a separate allocation.
+** Use xjd1JsonStrText() and xjd1JsonStrLen() to access string values
+** regardless of where they are stored.  The text of an XJD1_STR_BORROW
+** string is followed by the closing '"' of the JSON source, not a NUL.
+*/
+#define XJD1_STR_HEAP      0    /* u.str.z is from xjd1_malloc() */
+#define XJD1_STR_INLINE    1    /* Text is in u.zShort[] */
+#define XJD1_STR_STATIC    2    /* u.str.z is not owned by the node */
+#define XJD1_STR_BORROW    3    /* Text is a slice of u.src.pSrc */
+#define XJD1_SHORT_STR    15
+#define xjd1JsonStrText(P) \
+    ((P)->eStr==XJD1_STR_INLINE ? (P)->u.zShort :                  \
+     (P)->eStr==XJD1_STR_BORROW ?                                  \
+         xjd1JsonSrcText((P)->u.src.pSrc)+(P)->u.src.iOfst : (P)->u.str.z)
+#define xjd1JsonStrLen(P) \
+    ((P)->eStr==XJD1_STR_INLINE ? (int)(P)->nShort :               \
+     (P)->eStr==XJD1_STR_BORROW ? (P)->u.src.n : (P)->u.str.n)
 
-/* A single element of a JSON structure */
-struct JsonStructElem {
-  char *zLabel;             /* Label on this element */
-  JsonStructElem *pNext;    /* Next element of the structure */
-  JsonNode *pValue;         /* Value of this element */
+/*
+** A private copy of the text of a JSON document.  String values parsed
+** from the document that contain no escapes refer to a slice of this
+** text (XJD1_STR_BORROW) instead of holding a copy of their own.  Arrays
+** and structures that have not been edited since they were parsed
+** remember their span of this text (JsonNode.bSpan) so that they can be
+** rendered by copying it.  The text follows the JsonSrc header in
+** the same allocation.  It is freed once the last node referring to it
+** is freed.
+*/
+struct JsonSrc {
+  int nRef;                 /* Number of references */
+  int n;                    /* Bytes of text */
 };
+#define xjd1JsonSrcText(S)  ((char*)&(S)[1])
 
 /* A single element of a JSON value */
 struct JsonNode {
-  int eJType;               /* Element type */
+  u8 eJType;                /* Element type */
+  u8 eStr;                  /* Storage for XJD1_STRING.  XJD1_STR_* */
+  u8 nShort;                /* Length of u.zShort if eStr==XJD1_STR_INLINE */
+  u8 bSpan;                 /* Array or struct has a JsonSpan.  See json.c */
   int nRef;                 /* Number of references */
   union {
     int b;                  /* Boolean value */
     double r;               /* Real value */
-    char *z;                /* String value */
+    i64 i;                  /* Integer value */
+    struct {                /* String value.  XJD1_STR_HEAP or _STATIC */
+      char *z;                 /* Text.  Always zero-terminated */
+      int n;                   /* Length in bytes.  May contain NULs */
+    } str;
+    struct {                /* String value.  XJD1_STR_BORROW */
+      JsonSrc *pSrc;           /* Document text.  Holds a reference */
+      int iOfst;               /* Offset of first byte in pSrc */
+      int n;                   /* Length in bytes.  Not zero-terminated */
+    } src;
+    char zShort[XJD1_SHORT_STR+1];  /* Short string value, stored inline */
     struct {                /* Array value */
       int nElem;               /* Number of elements */
       JsonNode **apElem;       /* Value of each element */
     } ar;
     struct {                /* Struct value */
-      JsonStructElem *pFirst;  /* List of structure elements */
-      JsonStructElem *pLast;   /* Last element of the list */
+      JsonShape *pShape;       /* Labels.  NULL for an empty structure */
+      JsonNode **apValue;      /* Value for each label in pShape */
     } st;
   } u;
 };
 
-/* Values for eJType */
-#define XJD1_FALSE     0
-#define XJD1_TRUE      1
-#define XJD1_REAL      2
-#define XJD1_NULL      3
-#define XJD1_STRING    4
-#define XJD1_ARRAY     5
-#define XJD1_STRUCT    6
+/* Values for eJType are the datatypes XJD1_FALSE through XJD1_INT
+** defined in xjd1.h.  XJD1_INT sorts as if it were XJD1_REAL.
+*/
+
+/*
+** Build a 64-bit unsigned constant from two 32-bit halves.  This avoids
+** the need for "ULL" suffixes, which some older compilers reject.
+*/
+#define XJD1_U64(HI,LO)  ((((u64)(HI))<<32)|(u64)(LO))
+
+/* Limits of the XJD1_INT value */
+#define LARGEST_INT64  (0xffffffff|(((i64)0x7fffffff)<<32))
+#define SMALLEST_INT64 (((i64)-1) - LARGEST_INT64)
 
 /* Parsing context */
 struct Parse {
@@ -262,11 +444,29 @@ struct Parse {
   Token sTok;                     /* Last token seen */
   int errCode;                    /* Error code */
   String errMsg;                  /* Error message string */
+  int nParam;                     /* Number of distinct parameters */
+  char **azParam;                 /* Name of each parameter.  NULL for "?" */
+};
+
+/* Rows to be changed by an UPDATE or DELETE.  See writebuf.c */
+struct WriteBuf {
+  xjd1_stmt *pStmt;                 /* Statement making the changes */
+  const char *zName;                /* Collection being changed */
+  int isUpdate;                     /* True for UPDATE, false for DELETE */
+  int nRow;                         /* Rows held in memory */
+  int nAlloc;                       /* Slots allocated in aRowid and aiDoc */
+  i64 *aRowid;                      /* Rowid of each row */
+  int *aiDoc;                       /* Offset of each new document in sDoc */
+  String sDoc;                      /* New documents of an UPDATE */
+  int nByte;                        /* Memory used by rows in memory */
+  int isSpilled;                    /* True if rows are in _xjd1_spill */
+  int nChange;                      /* Total rows added */
 };
 
 /* A list of sorted results. */
 struct ResultList {
   Pool *pPool;
+  Pool *pSpare;                     /* Pool kept for reuse after a rewind */
   int nKey;
   ResultItem *pSaved;
   ResultItem *pItem;
@@ -339,6 +539,11 @@ struct DataSrc {
       char *zName;             /* The collection name */
       sqlite3_stmt *pStmt;     /* Cursor for reading content */
       int eofSeen;             /* True if at EOF */
+      const char *zRaw;        /* Stored text of the current document */
+      int nRaw;                /* Bytes in zRaw */
+      int isParsed;            /* True once zRaw is parsed into pValue */
+      int isTarget;            /* True if the INSERT target.  See iMaxRowid */
+      int needBind;            /* True if iMaxRowid is not yet bound */
     } tab;
     struct {                /* For a named collection.  eDSType==TK_ID */
       Expr *pPath;             /* Path to correlated variable */
@@ -378,7 +583,9 @@ struct Command {
     struct {                /* Insert */
       char *zName;             /* Table to insert into */
       Expr *pValue;            /* Value to be inserted */
+      ExprList *pList;         /* Values to be inserted, or NULL */
       Query *pQuery;           /* Query to insert from */
+      int isAsync;             /* True for ASYNC INSERT */
     } ins;
     struct {                /* Delete */
       char *zName;             /* Table to delete */
@@ -398,7 +605,16 @@ struct Command {
 };
 
 /******************************** context.c **********************************/
+void xjd1ContextRef(xjd1_context*);
 void xjd1ContextUnref(xjd1_context*);
+int xjd1ContextWal(xjd1_context*);
+
+/******************************** async.c ************************************/
+void xjd1AsyncInit(xjd1*);
+int xjd1AsyncPoll(xjd1*);
+int xjd1AsyncAppend(xjd1*,const char*,JsonNode*);
+int xjd1AsyncFlush(xjd1*);
+void xjd1AsyncClear(xjd1*);
 
 /******************************** conn.c *************************************/
 void xjd1Unref(xjd1*);
@@ -416,6 +632,7 @@ JsonNode *xjd1DataSrcCacheRead(DataSrc *, JsonNode **, const char *zDocname);
 void xjd1DataSrcCacheSave(DataSrc *, JsonNode **);
 int xjd1DataSrcResolve(DataSrc *, const char *zDocname);
 JsonNode *xjd1DataSrcRead(DataSrc *, int);
+int xjd1DataSrcRaw(DataSrc *, int, const char**, int*);
 
 /******************************** delete.c ***********************************/
 int xjd1DeleteStep(xjd1_stmt*);
@@ -437,31 +654,57 @@ int xjd1ExprListClose(ExprList*);
 #define XJD1_EXPR_LIMIT   6
 #define XJD1_EXPR_OFFSET  7
 
+/******************************** insert.c ***********************************/
+int xjd1InsertDoc(xjd1_stmt*,int,const char*,JsonNode*);
+int xjd1InsertStep(xjd1_stmt*);
+
 /******************************** json.c *************************************/
+void xjd1JsonInit(void);
 JsonNode *xjd1JsonParse(const char *zIn, int mxIn);
+int xjd1JsonParseEach(int(*)(void*,char*,int),void*,
+                      int(*)(void*,JsonNode*),void*);
 JsonNode *xjd1JsonRef(JsonNode*);
 void xjd1JsonRender(String*, const JsonNode*);
 int xjd1JsonToReal(const JsonNode*, double*);
+int xjd1JsonToInt(const JsonNode*, i64*);
+void xjd1JsonSetNumber(JsonNode*, const char*, int);
 int xjd1JsonToString(const JsonNode*, String*);
 int xjd1JsonCompare(const JsonNode*, const JsonNode*);
 JsonNode *xjd1JsonNew(Pool*);
 JsonNode *xjd1JsonEdit(JsonNode*);
+void xjd1JsonDropSpan(JsonNode*);
 JsonNode *xjd1JsonDeepCopy(JsonNode*);
 void xjd1JsonFree(JsonNode*);
 void xjd1JsonToNull(JsonNode*);
-void xjd1DequoteString(char*,int);
+int xjd1DequoteString(char*,int);
 int xjd1JsonInsert(JsonNode *, const char *, JsonNode *);
+int xjd1JsonStructFind(const JsonNode *, const char *, int);
+int xjd1JsonSetString(JsonNode*, const char*, int);
+int xjd1JsonSetStringBuf(JsonNode*, String*);
+JsonShape *xjd1JsonShapeNew(int, char *const*, const int*);
+void xjd1JsonShapeUnref(JsonShape*);
+#define xjd1JsonStructCount(P) \
+    ((P)->u.st.pShape ? (P)->u.st.pShape->nLabel : 0)
 int xjd1JsonTidy(String *, const char *);
 
 /******************************** memory.c ***********************************/
 Pool *xjd1PoolNew(void);
 void xjd1PoolClear(Pool*);
+void xjd1PoolReset(Pool*);
 void xjd1PoolDelete(Pool*);
 void *xjd1PoolMalloc(Pool*, int);
 void *xjd1PoolMallocZero(Pool*, int);
 char *xjd1PoolDup(Pool*, const char *, int);
 void *xjd1MallocZero(int);
 
+/******************************** number.c ***********************************/
+int xjd1IntToText(i64, char*);
+int xjd1RealToText(double, char*);
+int xjd1TextToNumber(const char*, int, i64*, double*);
+
+/* Space needed for the output of xjd1IntToText() or xjd1RealToText() */
+#define XJD1_REAL_TEXT 32
+
 /******************************** pragma.c ***********************************/
 int xjd1PragmaStep(xjd1_stmt*);
 
@@ -471,10 +714,13 @@ int xjd1QueryRewind(Query*);
 int xjd1QueryStep(Query*);
 int xjd1QueryClose(Query*);
 JsonNode *xjd1QueryDoc(Query*, int);
+int xjd1QueryRawDoc(Query*, const char**, int*);
 
 /******************************** stmt.c *************************************/
 JsonNode *xjd1StmtDoc(xjd1_stmt*);
 void xjd1StmtError(xjd1_stmt *,int,const char*,...);
+void xjd1StmtCacheFlush(xjd1*);
+sqlite3_stmt *xjd1StmtSql(xjd1_stmt*,int,const char*,...);
 
 /******************************** string.c ***********************************/
 int xjd1Strlen30(const char *);
@@ -511,9 +757,29 @@ void xjd1TraceDataSrc(String*,int,const DataSrc*);
 void xjd1TraceExpr(String*,const Expr*);
 void xjd1TraceExprList(String*,int, const ExprList*);
 
+/******************************** trans.c ************************************/
+/*
+** Values returned by xjd1TransBegin()
+*/
+#define TRANS_ERROR     -1    /* Could not start.  The statement must fail */
+#define TRANS_BEGIN      1    /* A new transaction was started */
+#define TRANS_SAVEPOINT  2    /* A savepoint inside an open transaction */
+
+int xjd1TransStep(xjd1_stmt*);
+int xjd1TransBegin(xjd1*);
+int xjd1TransEnd(xjd1*,int,int);
+int xjd1TransDepth(xjd1*);
+void xjd1TransClear(xjd1*);
+
 /******************************** update.c ***********************************/
 int xjd1UpdateStep(xjd1_stmt*);
 
+/******************************** writebuf.c *********************************/
+void xjd1WriteBufInit(WriteBuf*,xjd1_stmt*,const char*,int);
+int xjd1WriteBufAdd(WriteBuf*,i64,const char*,int);
+int xjd1WriteBufApply(WriteBuf*);
+void xjd1WriteBufClear(WriteBuf*);
+
 /******************************** func.c *************************************/
 int xjd1FunctionInit(Expr *p, xjd1_stmt *pStmt, Query *pQuery, int bAggOk);
 JsonNode *xjd1FunctionEval(Expr *p);
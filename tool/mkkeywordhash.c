@@ -106,6 +106,7 @@ static Keyword aKeywordTable[] = {
   { "UNION",        "TK_UNION",      },
   { "UPDATE",       "TK_UPDATE",     },
   { "VALUE",        "TK_VALUE",      },
+  { "VALUES",       "TK_VALUES",     },
   { "WHERE",        "TK_WHERE",      },
   { "WITHIN",       "TK_WITHIN",     },
 };